@@ -56,6 +56,27 @@ static const float g_Vertices[] = {
 	-1, -1, +1, 1, 1, -1
 };
 
+// Shader variants: every combination of coloring and iteration limit is compiled as a pixel
+// shader of its own, with the values passed to mandelbrot.hlsl as macros. A variant is
+// compiled the first time it is picked and kept until the file changes.
+typedef enum Coloring {
+	COLORING_SIMPLE,
+	COLORING_WAVE,
+	COLORING_WAVE_ANIMATED,
+	COLORING_SMOOTH,
+	COLORING_COUNT
+} Coloring;
+
+static const char *ColoringNames[COLORING_COUNT] = { "Simple", "Wave", "Animated wave", "Smooth" };
+static const char *ColoringDefines[COLORING_COUNT] = { "0", "1", "2", "3" };
+static const char *IterationLevels[] = { "100", "200", "500", "1000", "2000", "5000" };
+
+#define ITERATION_LEVELS (int)ArrayCount(IterationLevels)
+
+static ID3D11PixelShader *g_pixel_variants[COLORING_COUNT][ITERATION_LEVELS];
+static int g_coloring = COLORING_WAVE_ANIMATED;
+static int g_iteration_level = 2;
+
 static bool g_take_screenshot = false;
 
 void TakeScreenshot() {
@@ -356,6 +377,12 @@ LRESULT CALLBACK WindowProc(HWND wnd, UINT msg, WPARAM wparam, LPARAM lparam) {
 				ToggleFullscreen(wnd);
 			} else if (wparam == VK_F5 && ((lparam & (1 << 30)) != (1 << 30))) {
 				TakeScreenshot();
+			} else if (wparam >= '1' && wparam < '1' + COLORING_COUNT) {
+				g_coloring = (int)(wparam - '1');
+			} else if ((wparam == VK_OEM_PLUS || wparam == VK_ADD) && g_iteration_level + 1 < ITERATION_LEVELS) {
+				g_iteration_level += 1;
+			} else if ((wparam == VK_OEM_MINUS || wparam == VK_SUBTRACT) && g_iteration_level > 0) {
+				g_iteration_level -= 1;
 			}
 		} break;
 
@@ -424,10 +451,10 @@ LRESULT CALLBACK WindowProc(HWND wnd, UINT msg, WPARAM wparam, LPARAM lparam) {
 	return result;
 }
 
-ID3DBlob *CompileHLSL(ID3DBlob *source, const char *identifier, const char *entry_point, const char *target) {
+ID3DBlob *CompileHLSL(ID3DBlob *source, const char *identifier, const D3D_SHADER_MACRO *defines, const char *entry_point, const char *target) {
 	ID3DBlob *code = 0, *error_messages = 0;
 	HRESULT result = D3DCompile2(source->lpVtbl->GetBufferPointer(source), source->lpVtbl->GetBufferSize(source), 
-								 identifier, NULL, NULL, entry_point, target, 0, 0, 0, NULL, 0, 
+								 identifier, defines, NULL, entry_point, target, 0, 0, 0, NULL, 0, 
 								 &code, &error_messages);
 
 	bool success = true;
@@ -491,7 +518,16 @@ ULARGE_INTEGER GetFileAccessTime(HANDLE handle) {
 	return r;
 }
 
-bool LoadShader(HANDLE hfile, const char *identifier, 
+void GetShaderDefines(int coloring, int iteration_level, D3D_SHADER_MACRO defines[3]) {
+	defines[0].Name = "COLORING";
+	defines[0].Definition = ColoringDefines[coloring];
+	defines[1].Name = "MAX_ITERATIONS";
+	defines[1].Definition = IterationLevels[iteration_level];
+	defines[2].Name = NULL;
+	defines[2].Definition = NULL;
+}
+
+bool LoadShader(HANDLE hfile, const char *identifier, const D3D_SHADER_MACRO *defines,
 				ID3D11VertexShader **vertex_shader, ID3D11PixelShader **pixel_shader, 
 				ID3DBlob **layout) {
 	const char *vertex_entry = "vs_main";
@@ -501,9 +537,9 @@ bool LoadShader(HANDLE hfile, const char *identifier,
 	if (blob) {
 		HRESULT hres;
 
-		ID3DBlob *vertex = CompileHLSL(blob, identifier, vertex_entry, "vs_5_0");
+		ID3DBlob *vertex = CompileHLSL(blob, identifier, defines, vertex_entry, "vs_5_0");
 		if (vertex) {
-			ID3DBlob *pixel = CompileHLSL(blob, identifier, pixel_entry, "ps_5_0");
+			ID3DBlob *pixel = CompileHLSL(blob, identifier, defines, pixel_entry, "ps_5_0");
 
 			if (pixel) {
 				hres = g_device->lpVtbl->CreateVertexShader(g_device,
@@ -541,6 +577,44 @@ bool LoadShader(HANDLE hfile, const char *identifier,
 	return false;
 }
 
+bool LoadPixelShader(HANDLE hfile, const char *identifier, const D3D_SHADER_MACRO *defines, ID3D11PixelShader **pixel_shader) {
+	bool loaded = false;
+
+	ID3DBlob *blob = ReadEntireFile(hfile);
+	if (blob) {
+		ID3DBlob *pixel = CompileHLSL(blob, identifier, defines, "ps_main", "ps_5_0");
+		if (pixel) {
+			HRESULT hres = g_device->lpVtbl->CreatePixelShader(g_device,
+															   pixel->lpVtbl->GetBufferPointer(pixel), 
+															   pixel->lpVtbl->GetBufferSize(pixel), 
+															   NULL, pixel_shader);
+			loaded = SUCCEEDED(hres);
+			pixel->lpVtbl->Release(pixel);
+		}
+		blob->lpVtbl->Release(blob);
+	}
+
+	return loaded;
+}
+
+void ReleasePixelVariants() {
+	for (int coloring = 0; coloring < COLORING_COUNT; ++coloring) {
+		for (int level = 0; level < ITERATION_LEVELS; ++level) {
+			if (g_pixel_variants[coloring][level]) {
+				g_pixel_variants[coloring][level]->lpVtbl->Release(g_pixel_variants[coloring][level]);
+				g_pixel_variants[coloring][level] = NULL;
+			}
+		}
+	}
+}
+
+void UpdateWindowTitle(HWND window, int coloring, int iteration_level) {
+	char title[128];
+	snprintf(title, sizeof(title), "Mandelbrot (%s coloring, %s iterations)", 
+			 ColoringNames[coloring], IterationLevels[iteration_level]);
+	SetWindowTextA(window, title);
+}
+
 #pragma pack(push, 4)
 typedef struct Constant_Layout {
 	float2 Resolution;
@@ -630,13 +704,21 @@ int __stdcall wWinMain(HINSTANCE instance, HINSTANCE prev_instance, LPWSTR cmd_l
 	
 	ULARGE_INTEGER mod_time = GetFileAccessTime(hfile);
 
+	D3D_SHADER_MACRO defines[3];
+	GetShaderDefines(g_coloring, g_iteration_level, defines);
+
 	ID3D11VertexShader *vertex_shader = NULL;
 	ID3D11PixelShader *pixel_shader = NULL;
 	ID3DBlob *layout = NULL;
-	if (!LoadShader(hfile, file, &vertex_shader, &pixel_shader, &layout)) {
+	if (!LoadShader(hfile, file, defines, &vertex_shader, &pixel_shader, &layout)) {
 		FatalAppExitW(0, L"Failed to load shaders");
 	}
 
+	int coloring = g_coloring;
+	int iteration_level = g_iteration_level;
+	g_pixel_variants[coloring][iteration_level] = pixel_shader;
+	UpdateWindowTitle(window, coloring, iteration_level);
+
 	D3D11_INPUT_ELEMENT_DESC input_elements[] = {
 	{ "POSITION", 0, DXGI_FORMAT_R32G32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
 	};
@@ -680,20 +762,43 @@ int __stdcall wWinMain(HINSTANCE instance, HINSTANCE prev_instance, LPWSTR cmd_l
 			DispatchMessageW(&msg);
 		}
 
-		// Reload shader if modified
+		// Reload shader if modified, the other variants are compiled again when they are picked
 		ULARGE_INTEGER new_mod_time = GetFileAccessTime(hfile);
 		if (new_mod_time.QuadPart > mod_time.QuadPart) {
 			ID3D11VertexShader *new_vertex_shader;
 			ID3D11PixelShader *new_pixel_shader;
-			if (LoadShader(hfile, file, &new_vertex_shader, &new_pixel_shader, NULL)) {
+			GetShaderDefines(coloring, iteration_level, defines);
+			if (LoadShader(hfile, file, defines, &new_vertex_shader, &new_pixel_shader, NULL)) {
 				vertex_shader->lpVtbl->Release(vertex_shader);
-				pixel_shader->lpVtbl->Release(pixel_shader);
+				ReleasePixelVariants();
 				vertex_shader = new_vertex_shader;
 				pixel_shader = new_pixel_shader;
+				g_pixel_variants[coloring][iteration_level] = pixel_shader;
 			}
 		}
 		mod_time = new_mod_time;
 
+		// Switch to the variant picked with the keys, it stays on the old one if it fails to compile
+		if (coloring != g_coloring || iteration_level != g_iteration_level) {
+			ID3D11PixelShader *variant = g_pixel_variants[g_coloring][g_iteration_level];
+			if (!variant) {
+				GetShaderDefines(g_coloring, g_iteration_level, defines);
+				if (LoadPixelShader(hfile, file, defines, &variant)) {
+					g_pixel_variants[g_coloring][g_iteration_level] = variant;
+				}
+			}
+
+			if (variant) {
+				coloring = g_coloring;
+				iteration_level = g_iteration_level;
+				pixel_shader = variant;
+				UpdateWindowTitle(window, coloring, iteration_level);
+			} else {
+				g_coloring = coloring;
+				g_iteration_level = iteration_level;
+			}
+		}
+
 		RECT rect;
 		GetClientRect(window, &rect);
 
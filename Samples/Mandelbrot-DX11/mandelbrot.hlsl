@@ -1,3 +1,18 @@
+// MAX_ITERATIONS and COLORING are defined by the program for every shader variant,
+// the values here are only used when the file is compiled on its own
+#ifndef MAX_ITERATIONS
+#define MAX_ITERATIONS 500
+#endif
+
+#define COLORING_SIMPLE         0
+#define COLORING_WAVE           1
+#define COLORING_WAVE_ANIMATED  2
+#define COLORING_SMOOTH         3
+
+#ifndef COLORING
+#define COLORING COLORING_WAVE_ANIMATED
+#endif
+
 cbuffer constants : register(b0) {
 	float2 Resolution;
 	float2 RectMin;
@@ -24,7 +39,7 @@ float3 HSV2RGB(float3 c) {
 }
 
 float3 Mandelbrot_SimpleColoring(float2 c) {
-	const uint MaxIterations = 200;
+	const uint MaxIterations = MAX_ITERATIONS;
 	const float Radius = 4.0f;
 	const float3 ColorWeight = float3(2.0, 4.0, 5.0);
 	
@@ -41,7 +56,7 @@ float3 Mandelbrot_SimpleColoring(float2 c) {
 }
 
 float3 Mandelbrot_WaveColoring(float2 c) {
-	const uint MaxIterations = 200;
+	const uint MaxIterations = MAX_ITERATIONS;
 	const float Radius = 2.0;
 	const float Amount = 0.7;
 	
@@ -61,7 +76,7 @@ float3 Mandelbrot_WaveColoring(float2 c) {
 }
 
 float3 Mandelbrot_WaveColoringAnimated(float2 c) {
-	const uint MaxIterations = 500;
+	const uint MaxIterations = MAX_ITERATIONS;
 	const float Radius = 2.0;
 	const float Amount = 0.07;
 	const float Speed = 1;
@@ -82,7 +97,7 @@ float3 Mandelbrot_WaveColoringAnimated(float2 c) {
 }
 
 float3 Mandelbrot_SmoothColoring(float2 c) {
-	const uint MaxIterations = 500;
+	const uint MaxIterations = MAX_ITERATIONS;
 	const float Radius = 2.0;
 	const float Saturation = 1.0;
 	const float Value = 0.8;
@@ -119,10 +134,15 @@ float4 ps_main(float4 Position : SV_Position) : SV_TARGET0 {
 	float2 st = Position.xy / Resolution;	
 	float2 z = Center + (RectMin + st * (RectMax - RectMin)) * Zoom * float2(AspectRatio, 1);
 	
+#if COLORING == COLORING_SIMPLE
+	float3 color = Mandelbrot_SimpleColoring(z);
+#elif COLORING == COLORING_WAVE
+	float3 color = Mandelbrot_WaveColoring(z);
+#elif COLORING == COLORING_SMOOTH
+	float3 color = Mandelbrot_SmoothColoring(z);
+#else
 	float3 color = Mandelbrot_WaveColoringAnimated(z);
-	//float3 color = Mandelbrot_WaveColoring(z);
-	//float3 color = Mandelbrot_SmoothColoring(z);
-	//float3 color = Mandelbrot_SimpleColoring(z);
+#endif
 	
 	return float4(color, 1);
 }
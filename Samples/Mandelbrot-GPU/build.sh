@@ -2,13 +2,26 @@
 
 SourceFiles="../../main.c ../../glfw/src/context.c ../../glfw/src/egl_context.c ../../glfw/src/glx_context.c ../../glfw/src/init.c ../../glfw/src/input.c ../../glfw/src/linux_joystick.c ../../glfw/src/monitor.c ../../glfw/src/osmesa_context.c ../../glfw/src/posix_thread.c ../../glfw/src/posix_time.c ../../glfw/src/vulkan.c ../../glfw/src/window.c ../../glfw/src/x11_init.c ../../glfw/src/x11_monitor.c ../../glfw/src/x11_window.c ../../glfw/src/xkb_unicode.c ../../glad/src/glad.c"
 IncludeDirs="-I../../glfw/include/ -I../../glad/include/"
+Platform=-D_GLFW_X11
+Libraries="-ldl -lGL -lpthread -lm"
+Output=Mandelbrot-GPU.out
 
 CompilerFlags=-O
-if [ "$1" == "optimize" ]; then
-	CompilerFlags=-O2
-	echo --------------------------------------------------
-	echo Compiling with Optimizations
-fi
+for Option in "$@"; do
+	if [ "$Option" == "optimize" ]; then
+		CompilerFlags=-O2
+		echo --------------------------------------------------
+		echo Compiling with Optimizations
+	elif [ "$Option" == "headless" ]; then
+		# GLFW's null platform with an OSMesa context, libOSMesa is loaded at runtime
+		SourceFiles="../../main.c ../../glfw/src/context.c ../../glfw/src/init.c ../../glfw/src/input.c ../../glfw/src/monitor.c ../../glfw/src/null_init.c ../../glfw/src/null_joystick.c ../../glfw/src/null_monitor.c ../../glfw/src/null_window.c ../../glfw/src/osmesa_context.c ../../glfw/src/posix_thread.c ../../glfw/src/posix_time.c ../../glfw/src/vulkan.c ../../glfw/src/window.c ../../glad/src/glad.c"
+		Platform=-D_GLFW_OSMESA
+		Libraries="-ldl -lpthread -lm"
+		Output=Mandelbrot-GPU-headless.out
+		echo --------------------------------------------------
+		echo Compiling headless with OSMesa
+	fi
+done
 
 mkdir -p bin
 
@@ -19,7 +32,7 @@ if [ $? == 0 ]; then
 	cp Logo.bmp bin/CLANG/ &> /dev/null
 	pushd bin/CLANG &> /dev/null
 	echo Compiling with CLANG...
-	clang $CompilerFlags $IncludeDirs -Wno-switch -Wno-pointer-sign -D_GLFW_X11 $SourceFiles -o Mandelbrot-GPU.out -ldl -lGL -lpthread -lm
+	clang $CompilerFlags $IncludeDirs -Wno-switch -Wno-pointer-sign $Platform $SourceFiles -o $Output $Libraries
 	popd &> /dev/null
 	echo Compiling with CLANG finished.
   cp -t ./bin/CLANG/ *.vert *.frag
@@ -34,7 +47,7 @@ if [ $? == 0 ]; then
 	cp Logo.bmp bin/GCC/ &> /dev/null
 	pushd bin/GCC &> /dev/null
 	echo Compiling with GCC...
-	gcc $CompilerFlags $IncludeDirs -g -Wno-switch -Wno-pointer-sign -Wno-unused-result -D_GLFW_X11 $SourceFiles -o Mandelbrot-GPU.out -ldl -lGL -lpthread -lm
+	gcc $CompilerFlags $IncludeDirs -g -Wno-switch -Wno-pointer-sign -Wno-unused-result $Platform $SourceFiles -o $Output $Libraries
 	popd &> /dev/null
 	echo Compiling with GCC finished.
   cp -t ./bin/GCC/ *.vert *.frag
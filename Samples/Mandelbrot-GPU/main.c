@@ -8,6 +8,9 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
 
 static const float g_Vertices[] = {
     -1, -1, -1, 1, 1, +1,
@@ -43,15 +46,60 @@ uint64_t GetFileModifiedTime(const char *file) {
 
     return result;
 }
+
+void MakeDirectory(const char *path) {
+    CreateDirectoryA(path, NULL);
+}
+
+uint32_t AtomicExchange(volatile uint32_t *value, uint32_t exchange) {
+    return (uint32_t)InterlockedExchange((volatile LONG *)value, (LONG)exchange);
+}
+
+uint32_t AtomicLoad(volatile uint32_t *value) {
+    return *value;
+}
+
+uint64_t AtomicExchange64(volatile uint64_t *value, uint64_t exchange) {
+    return (uint64_t)InterlockedExchange64((volatile LONG64 *)value, (LONG64)exchange);
+}
+
+uint64_t AtomicLoad64(volatile uint64_t *value) {
+    return (uint64_t)InterlockedCompareExchange64((volatile LONG64 *)value, 0, 0);
+}
 #else
 #include <sys/stat.h>
+#include <sys/inotify.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
 uint64_t GetFileModifiedTime(const char *file) {
     struct stat buf;
-    if (stat(file, &buf)) {
-        return buf.st_mtime;
+    if (stat(file, &buf) == 0) {
+        // nanoseconds, two saves within the same second are still told apart
+        return (uint64_t)buf.st_mtim.tv_sec * 1000000000 + (uint64_t)buf.st_mtim.tv_nsec;
     }
     return 0;
 }
+
+void MakeDirectory(const char *path) {
+    mkdir(path, 0755);
+}
+
+uint32_t AtomicExchange(volatile uint32_t *value, uint32_t exchange) {
+    return __atomic_exchange_n(value, exchange, __ATOMIC_ACQ_REL);
+}
+
+uint32_t AtomicLoad(volatile uint32_t *value) {
+    return __atomic_load_n(value, __ATOMIC_ACQUIRE);
+}
+
+uint64_t AtomicExchange64(volatile uint64_t *value, uint64_t exchange) {
+    return __atomic_exchange_n(value, exchange, __ATOMIC_ACQ_REL);
+}
+
+uint64_t AtomicLoad64(volatile uint64_t *value) {
+    return __atomic_load_n(value, __ATOMIC_ACQUIRE);
+}
 #endif
 
 char *ReadEntireFile(const char *file, uint64_t *time) {
@@ -175,9 +223,22 @@ unsigned char *LoadBMP(const char *file, int *w, int *h) {
     return pixels;
 }
 
-GLuint CompileShader(GLenum type, const char *code) {
+GLuint CompileShader(GLenum type, const char *code, const char *defines) {
+    // the defines have to come after the #version line, #line keeps the line numbers of
+    // compile errors matching the file
+    const char *body = code;
+    if (strncmp(code, "#version", 8) == 0) {
+        const char *end = strchr(code, '\n');
+        body = end ? end + 1 : code + strlen(code);
+    }
+    char line[32];
+    snprintf(line, sizeof(line), "#line %d\n", body == code ? 1 : 2);
+
+    const char *parts[] = { code, defines, line, body };
+    GLint lengths[] = { (GLint)(body - code), -1, -1, -1 };
+
     GLuint shader = glCreateShader(type);
-    glShaderSource(shader, 1, &code, NULL);
+    glShaderSource(shader, 4, parts, lengths);
     glCompileShader(shader);
 
     GLint success;
@@ -202,95 +263,554 @@ typedef struct Shader {
 static const char *VertexFile = "mandelbrot.vert";
 static const char *FragmentFile = "mandelbrot.frag";
 
-bool LoadShader(Shader *shader) {
-    char *vertex_code = ReadEntireFile(VertexFile, &shader->v_tmod);
-    char *fragment_code = ReadEntireFile(FragmentFile, &shader->f_tmod);
+// Shader variants: every combination of coloring, iteration limit and precision is compiled
+// as a program of its own, with the values passed to mandelbrot.frag as #defines. The
+// iteration loop then has a constant bound and only the chosen coloring and arithmetic are
+// compiled in, so a cheap variant costs nothing for the features of the expensive ones.
+typedef enum Coloring {
+    COLORING_SIMPLE,
+    COLORING_WAVE,
+    COLORING_WAVE_ANIMATED,
+    COLORING_SMOOTH,
+    COLORING_COUNT
+} Coloring;
+
+static const char *ColoringNames[COLORING_COUNT] = { "Simple", "Wave", "Animated wave", "Smooth" };
+static const int IterationLevels[] = { 100, 200, 500, 1000, 2000, 5000 };
+
+#define ITERATION_LEVELS (int)(sizeof(IterationLevels) / sizeof(IterationLevels[0]))
+#define SHADER_VARIANTS (2 * COLORING_COUNT * ITERATION_LEVELS)
+#define DEFAULT_ITERATION_LEVEL 2
+// marks a variant that failed to compile, it is tried again once the sources change
+#define FAILED_VARIANT ((GLuint)-1)
+
+// double_float picks the emulated double precision arithmetic for deep zooms
+int ShaderVariant(int coloring, int level, bool double_float) {
+    return ((double_float ? COLORING_COUNT : 0) + coloring) * ITERATION_LEVELS + level;
+}
 
-    if (vertex_code && fragment_code) {
-        GLuint vertex = CompileShader(GL_VERTEX_SHADER, vertex_code);
-        GLuint fragment = CompileShader(GL_FRAGMENT_SHADER, fragment_code);
+void GetShaderDefines(int variant, char *defines, size_t size) {
+    int coloring = variant / ITERATION_LEVELS;
+    snprintf(defines, size, "#define MAX_ITERATIONS %d\n#define COLORING %d\n#define DOUBLE_FLOAT %d\n",
+             IterationLevels[variant % ITERATION_LEVELS], coloring % COLORING_COUNT, coloring >= COLORING_COUNT);
+}
 
-        if (vertex == -1 || fragment == -1) {
-            free(vertex_code);
-            free(fragment_code);
-            return false;
-        }
+bool LinkProgram(const char *vertex_code, const char *fragment_code, const char *defines, GLuint *program) {
+    GLuint vertex = CompileShader(GL_VERTEX_SHADER, vertex_code, "");
+    GLuint fragment = CompileShader(GL_FRAGMENT_SHADER, fragment_code, defines);
 
-        GLuint id = glCreateProgram();
-        glAttachShader(id, vertex);
-        glAttachShader(id, fragment);
-        glLinkProgram(id);
-        
-        GLint success;
-        glGetProgramiv(id, GL_LINK_STATUS, &success); 
-        if (!success) {
-            GLchar message[512];
-            glGetProgramInfoLog(id, 512, NULL, message);
-            fprintf(stderr, "Linking Shader faliled: %s\n", message);
-            glDeleteShader(vertex);
-            glDeleteShader(fragment);
-            glDeleteProgram(id);
-            free(vertex_code);
-            free(fragment_code);
-            return false;
-        }
+    if (vertex == -1 || fragment == -1) {
+        return false;
+    }
+
+    GLuint id = glCreateProgram();
+    glAttachShader(id, vertex);
+    glAttachShader(id, fragment);
+    glProgramParameteri(id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    glLinkProgram(id);
 
+    GLint success;
+    glGetProgramiv(id, GL_LINK_STATUS, &success);
+    if (!success) {
+        GLchar message[512];
+        glGetProgramInfoLog(id, 512, NULL, message);
+        fprintf(stderr, "Linking Shader faliled: %s\n", message);
         glDeleteShader(vertex);
         glDeleteShader(fragment);
+        glDeleteProgram(id);
+        return false;
+    }
+
+    glDeleteShader(vertex);
+    glDeleteShader(fragment);
+
+    *program = id;
+
+    return true;
+}
+
+// Linked programs are kept in ShaderCacheDirectory as the driver's own binary format, so a
+// shader that was compiled once before loads without compiling. The file name is a hash of
+// both sources, the defines of the variant and the driver strings; a driver update gives every shader a new name, and a
+// binary the driver rejects anyway is compiled again and overwritten.
+static const char *ShaderCacheDirectory = "shader_cache";
+
+#define SHADER_CACHE_MAGIC 0x3142504d // "MPB1"
+
+typedef struct ShaderCacheHeader {
+    uint32_t magic;
+    uint32_t format;
+    uint32_t length;
+} ShaderCacheHeader;
+
+uint64_t HashString(uint64_t hash, const char *string) {
+    // FNV-1a, the terminator is hashed too so that "ab" + "c" differs from "a" + "bc"
+    const unsigned char *c = (const unsigned char *)string;
+    do {
+        hash ^= *c;
+        hash *= 0x100000001b3ull;
+    } while (*c++);
+    return hash;
+}
+
+uint64_t ShaderCacheKey(const char *vertex_code, const char *fragment_code, const char *defines) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    hash = HashString(hash, (const char *)glGetString(GL_VENDOR));
+    hash = HashString(hash, (const char *)glGetString(GL_RENDERER));
+    hash = HashString(hash, (const char *)glGetString(GL_VERSION));
+    hash = HashString(hash, vertex_code);
+    hash = HashString(hash, fragment_code);
+    hash = HashString(hash, defines);
+    return hash;
+}
+
+void GetShaderCachePath(uint64_t key, char *path, size_t size) {
+    snprintf(path, size, "%s/%016llx.bin", ShaderCacheDirectory, (unsigned long long)key);
+}
+
+bool LoadCachedProgram(uint64_t key, GLuint *program) {
+    char path[1024];
+    GetShaderCachePath(key, path, sizeof(path));
+
+    FILE *f = fopen(path, "rb");
+    if (!f) return false;
+
+    ShaderCacheHeader header;
+    void *binary = NULL;
+    bool loaded = false;
+    if (fread(&header, sizeof(header), 1, f) == 1 && header.magic == SHADER_CACHE_MAGIC) {
+        binary = malloc(header.length);
+        if (binary && fread(binary, 1, header.length, f) == header.length) {
+            GLuint id = glCreateProgram();
+            glProgramBinary(id, header.format, binary, (GLsizei)header.length);
+
+            GLint success;
+            glGetProgramiv(id, GL_LINK_STATUS, &success);
+            if (success) {
+                *program = id;
+                loaded = true;
+            } else {
+                glDeleteProgram(id);
+            }
+        }
+    }
+
+    free(binary);
+    fclose(f);
+
+    return loaded;
+}
+
+void StoreCachedProgram(uint64_t key, GLuint program) {
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) return;
+
+    ShaderCacheHeader header;
+    header.magic = SHADER_CACHE_MAGIC;
+    header.length = (uint32_t)length;
+
+    void *binary = malloc(length);
+    if (!binary) return;
+
+    GLenum format;
+    glGetProgramBinary(program, length, NULL, &format, binary);
+    header.format = format;
+
+    char path[1024], part[1040];
+    GetShaderCachePath(key, path, sizeof(path));
+    snprintf(part, sizeof(part), "%s.part", path);
+
+    // written under another name first, a crash never leaves a truncated entry behind
+    MakeDirectory(ShaderCacheDirectory);
+    FILE *f = fopen(part, "wb");
+    if (f) {
+        bool written = fwrite(&header, sizeof(header), 1, f) == 1 && fwrite(binary, 1, length, f) == (size_t)length;
+        if (fclose(f) == 0 && written) {
+            remove(path);
+            rename(part, path);
+        } else {
+            remove(part);
+        }
+    }
+
+    free(binary);
+}
 
-        free(vertex_code);
-        free(fragment_code);
+bool LoadShader(Shader *shader, int variant) {
+    char *vertex_code = ReadEntireFile(VertexFile, &shader->v_tmod);
+    char *fragment_code = ReadEntireFile(FragmentFile, &shader->f_tmod);
 
-        shader->id = id;
+    char defines[128];
+    GetShaderDefines(variant, defines, sizeof(defines));
 
-        return true;
+    bool loaded = false;
+    if (vertex_code && fragment_code) {
+        uint64_t key = ShaderCacheKey(vertex_code, fragment_code, defines);
+        if (LoadCachedProgram(key, &shader->id)) {
+            loaded = true;
+        } else if (LinkProgram(vertex_code, fragment_code, defines, &shader->id)) {
+            StoreCachedProgram(key, shader->id);
+            loaded = true;
+        }
     }
 
-    return false;
+    free(vertex_code);
+    free(fragment_code);
+
+    return loaded;
+}
+
+// Hot reload runs on a thread of its own: it sleeps until the directory of a shader file
+// changes, then reads, compiles and links the shaders on a hidden context that shares its
+// objects with the window. The render loop only swaps in a finished program, checking for
+// one is a single atomic load and never touches the file system. Only the variant in use is
+// rebuilt, the others are compiled again when they are picked the next time.
+typedef struct ShaderWatcher {
+    GLFWwindow *context;
+    uint64_t v_tmod;
+    uint64_t f_tmod;
+
+    volatile uint64_t ready;   // variant << 32 | linked program waiting to be swapped in, 0 if there is none
+    volatile uint32_t variant; // variant in use
+    volatile uint32_t running;
+
+#ifdef _GLFW_WIN32
+    HANDLE thread;
+    HANDLE changes[2];
+#else
+    pthread_t thread;
+    int inotify;
+#endif
+} ShaderWatcher;
+
+// Saving a file often takes several writes, the shaders are only read once they settle
+#define SHADER_SETTLE_MS 50
+
+void GetFileDirectory(const char *file, char *directory, size_t size) {
+    const char *end = strrchr(file, '/');
+#ifdef _GLFW_WIN32
+    const char *backslash = strrchr(file, '\\');
+    if (backslash > end) end = backslash;
+#endif
+    if (!end) {
+        snprintf(directory, size, ".");
+    } else {
+        snprintf(directory, size, "%.*s", (int)(end - file + 1), file);
+    }
 }
 
-bool ReloadShaderIfFileChanged(Shader *shader) {
+void RebuildWatchedShader(ShaderWatcher *watcher) {
     uint64_t vtime = GetFileModifiedTime(VertexFile);
     uint64_t ftime = GetFileModifiedTime(FragmentFile);
+    if (vtime == watcher->v_tmod && ftime == watcher->f_tmod)
+        return;
+
+    uint32_t variant = AtomicLoad(&watcher->variant);
+    Shader nshader;
+    bool loaded = LoadShader(&nshader, variant);
+    // a shader that fails to compile is not retried until it changes again
+    watcher->v_tmod = nshader.v_tmod;
+    watcher->f_tmod = nshader.f_tmod;
+    if (!loaded)
+        return;
+
+    // the program has to be complete before another context may use it
+    glFinish();
+
+    uint64_t unused = AtomicExchange64(&watcher->ready, ((uint64_t)variant << 32) | nshader.id);
+    if (unused) {
+        glDeleteProgram((GLuint)unused);
+    }
+}
 
-    if (shader->v_tmod < vtime || shader->f_tmod < ftime) {
-        Shader nshader;
-        if (LoadShader(&nshader)) {
-            printf("Hot reloaded shader!\n");
-            *shader = nshader;
-            return true;
-        } else {
-            shader->v_tmod = vtime;
-            shader->f_tmod = ftime;
-            return false;
+#ifdef _GLFW_WIN32
+bool WaitForShaderChange(ShaderWatcher *watcher) {
+    DWORD count = watcher->changes[1] ? 2 : 1;
+    DWORD wait = WaitForMultipleObjects(count, watcher->changes, FALSE, 250);
+    if (wait == WAIT_TIMEOUT || wait == WAIT_FAILED)
+        return false;
+
+    do {
+        for (DWORD index = 0; index < count; ++index) {
+            FindNextChangeNotification(watcher->changes[index]);
+        }
+        wait = WaitForMultipleObjects(count, watcher->changes, FALSE, SHADER_SETTLE_MS);
+    } while (wait != WAIT_TIMEOUT && wait != WAIT_FAILED);
+
+    return true;
+}
+
+DWORD WINAPI ShaderWatcherProc(void *data) {
+    ShaderWatcher *watcher = (ShaderWatcher *)data;
+    glfwMakeContextCurrent(watcher->context);
+    while (AtomicLoad(&watcher->running)) {
+        if (WaitForShaderChange(watcher)) {
+            RebuildWatchedShader(watcher);
         }
     }
+    glfwMakeContextCurrent(NULL);
+    return 0;
+}
+
+bool StartShaderWatcher(ShaderWatcher *watcher) {
+    char vertex_dir[1024], fragment_dir[1024];
+    GetFileDirectory(VertexFile, vertex_dir, sizeof(vertex_dir));
+    GetFileDirectory(FragmentFile, fragment_dir, sizeof(fragment_dir));
+
+    DWORD filter = FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME;
+    watcher->changes[0] = FindFirstChangeNotificationA(vertex_dir, FALSE, filter);
+    watcher->changes[1] = NULL;
+    if (strcmp(vertex_dir, fragment_dir) != 0) {
+        watcher->changes[1] = FindFirstChangeNotificationA(fragment_dir, FALSE, filter);
+    }
+    if (watcher->changes[0] == INVALID_HANDLE_VALUE || watcher->changes[1] == INVALID_HANDLE_VALUE) {
+        fprintf(stderr, "Failed to watch the shader files, hot reload is disabled\n");
+        if (watcher->changes[0] != INVALID_HANDLE_VALUE) FindCloseChangeNotification(watcher->changes[0]);
+        if (watcher->changes[1] && watcher->changes[1] != INVALID_HANDLE_VALUE) FindCloseChangeNotification(watcher->changes[1]);
+        return false;
+    }
+
+    watcher->running = 1;
+    watcher->thread = CreateThread(NULL, 0, ShaderWatcherProc, watcher, 0, NULL);
+    return true;
+}
+
+void StopShaderWatcher(ShaderWatcher *watcher) {
+    AtomicExchange(&watcher->running, 0);
+    WaitForSingleObject(watcher->thread, INFINITE);
+    CloseHandle(watcher->thread);
+    FindCloseChangeNotification(watcher->changes[0]);
+    if (watcher->changes[1]) FindCloseChangeNotification(watcher->changes[1]);
+}
+#else
+bool WaitForShaderChange(ShaderWatcher *watcher) {
+    struct pollfd fd = { watcher->inotify, POLLIN, 0 };
+    if (poll(&fd, 1, 250) <= 0)
+        return false;
+
+    // the events are not looked at, the modified times tell whether a shader file changed
+    char events[4096];
+    do {
+        if (read(watcher->inotify, events, sizeof(events)) <= 0)
+            break;
+    } while (poll(&fd, 1, SHADER_SETTLE_MS) > 0);
+
+    return true;
+}
+
+void *ShaderWatcherProc(void *data) {
+    ShaderWatcher *watcher = (ShaderWatcher *)data;
+    glfwMakeContextCurrent(watcher->context);
+    while (AtomicLoad(&watcher->running)) {
+        if (WaitForShaderChange(watcher)) {
+            RebuildWatchedShader(watcher);
+        }
+    }
+    glfwMakeContextCurrent(NULL);
+    return NULL;
+}
+
+bool StartShaderWatcher(ShaderWatcher *watcher) {
+    char vertex_dir[1024], fragment_dir[1024];
+    GetFileDirectory(VertexFile, vertex_dir, sizeof(vertex_dir));
+    GetFileDirectory(FragmentFile, fragment_dir, sizeof(fragment_dir));
+
+    // editors that save through a temporary file replace the shader with a rename
+    uint32_t mask = IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE;
+    watcher->inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watcher->inotify < 0 ||
+        inotify_add_watch(watcher->inotify, vertex_dir, mask) < 0 ||
+        inotify_add_watch(watcher->inotify, fragment_dir, mask) < 0) {
+        fprintf(stderr, "Failed to watch the shader files, hot reload is disabled\n");
+        if (watcher->inotify >= 0) close(watcher->inotify);
+        return false;
+    }
 
-    return false;
+    watcher->running = 1;
+    if (pthread_create(&watcher->thread, NULL, ShaderWatcherProc, watcher) != 0) {
+        close(watcher->inotify);
+        return false;
+    }
+    return true;
 }
 
+void StopShaderWatcher(ShaderWatcher *watcher) {
+    AtomicExchange(&watcher->running, 0);
+    pthread_join(watcher->thread, NULL);
+    close(watcher->inotify);
+}
+#endif
+
 typedef struct Mandelbrot {
     Shader shader;
     GLint u_resolution;
     GLint u_rect_min;
     GLint u_rect_max;
+    GLint u_rect_min_lo;
+    GLint u_rect_size;
+    GLint u_time;
+
+    GLuint variants[SHADER_VARIANTS]; // compiled on first use, 0 until then or FAILED_VARIANT
+    int coloring;
+    int iteration_level;
+    bool double_float;
+    ShaderWatcher *watcher;           // told about the variant in use, NULL without hot reload
 
-    float rect_min[2];
-    float rect_max[2];
+    float time;
 
-    float aspect_ratio;
+    double rect_min[2];
+    double rect_max[2];
+
+    double aspect_ratio;
 } Mandelbrot;
 
 void LoadShaderLocations(Mandelbrot *mandelbrot) {
     mandelbrot->u_resolution = glGetUniformLocation(mandelbrot->shader.id, "u_Resolution");
     mandelbrot->u_rect_min = glGetUniformLocation(mandelbrot->shader.id, "u_RectMin");
     mandelbrot->u_rect_max = glGetUniformLocation(mandelbrot->shader.id, "u_RectMax");
+    mandelbrot->u_rect_min_lo = glGetUniformLocation(mandelbrot->shader.id, "u_RectMinLo");
+    mandelbrot->u_rect_size = glGetUniformLocation(mandelbrot->shader.id, "u_RectSize");
+    mandelbrot->u_time = glGetUniformLocation(mandelbrot->shader.id, "u_Time");
 }
 
-float MapRange(float from_x1, float from_x2, float to_x1, float to_x2, float x) {
+bool SelectShaderVariant(Mandelbrot *mandelbrot, int coloring, int level, bool double_float) {
+    int variant = ShaderVariant(coloring, level, double_float);
+    // callers like UpdatePrecision ask every frame, a broken variant must not be compiled every time
+    if (mandelbrot->variants[variant] == FAILED_VARIANT)
+        return false;
+    if (!mandelbrot->variants[variant]) {
+        Shader shader;
+        if (!LoadShader(&shader, variant)) {
+            mandelbrot->variants[variant] = FAILED_VARIANT;
+            return false;
+        }
+        mandelbrot->shader = shader;
+        mandelbrot->variants[variant] = shader.id;
+    }
+
+    mandelbrot->coloring = coloring;
+    mandelbrot->iteration_level = level;
+    mandelbrot->double_float = double_float;
+    mandelbrot->shader.id = mandelbrot->variants[variant];
+    LoadShaderLocations(mandelbrot);
+
+    if (mandelbrot->watcher) {
+        AtomicExchange(&mandelbrot->watcher->variant, (uint32_t)variant);
+    }
+    return true;
+}
+
+// Called every frame by the render loop, true when a new program was swapped in
+bool SwapInWatchedShader(ShaderWatcher *watcher, Mandelbrot *mandelbrot) {
+    if (!AtomicLoad64(&watcher->ready))
+        return false;
+
+    uint64_t ready = AtomicExchange64(&watcher->ready, 0);
+    int ready_variant = (int)(ready >> 32);
+
+    // the sources changed, every other compiled variant is out of date and every failed one may
+    // compile now. The old programs are only deleted once a new one is in use, until then the
+    // current one may still be drawn.
+    GLuint outdated[SHADER_VARIANTS];
+    memcpy(outdated, mandelbrot->variants, sizeof(outdated));
+    memset(mandelbrot->variants, 0, sizeof(mandelbrot->variants));
+    mandelbrot->variants[ready_variant] = (GLuint)ready;
+    printf("Hot reloaded shader!\n");
+
+    // the variant may have changed while the watcher was compiling, then it is compiled here
+    // and the reloaded one is used if that fails
+    if (!SelectShaderVariant(mandelbrot, mandelbrot->coloring, mandelbrot->iteration_level, mandelbrot->double_float)) {
+        int coloring = ready_variant / ITERATION_LEVELS;
+        SelectShaderVariant(mandelbrot, coloring % COLORING_COUNT, ready_variant % ITERATION_LEVELS, coloring >= COLORING_COUNT);
+    }
+
+    for (int variant = 0; variant < SHADER_VARIANTS; ++variant) {
+        if (outdated[variant] && outdated[variant] != FAILED_VARIANT) {
+            glDeleteProgram(outdated[variant]);
+        }
+    }
+    return true;
+}
+
+void UpdateWindowTitle(GLFWwindow *window, Mandelbrot *mandelbrot) {
+    char title[128];
+    snprintf(title, sizeof(title), "Mandelbrot-GPU (%s coloring, %d iterations%s)",
+             ColoringNames[mandelbrot->coloring], IterationLevels[mandelbrot->iteration_level],
+             mandelbrot->double_float ? ", double-float" : "");
+    glfwSetWindowTitle(window, title);
+}
+
+// [1] to [4] pick the coloring, [+] and [-] the iteration limit
+void HandleKeyEvent(GLFWwindow *window, int key, int scancode, int action, int mods) {
+    if (action == GLFW_RELEASE)
+        return;
+
+    Mandelbrot *mandelbrot = (Mandelbrot *)glfwGetWindowUserPointer(window);
+    int coloring = mandelbrot->coloring;
+    int level = mandelbrot->iteration_level;
+
+    if (key >= GLFW_KEY_1 && key < GLFW_KEY_1 + COLORING_COUNT) {
+        coloring = key - GLFW_KEY_1;
+    } else if ((key == GLFW_KEY_EQUAL || key == GLFW_KEY_KP_ADD) && level + 1 < ITERATION_LEVELS) {
+        level += 1;
+    } else if ((key == GLFW_KEY_MINUS || key == GLFW_KEY_KP_SUBTRACT) && level > 0) {
+        level -= 1;
+    } else {
+        return;
+    }
+
+    // a variant that fails to compile leaves the current one in use
+    if (SelectShaderVariant(mandelbrot, coloring, level, mandelbrot->double_float)) {
+        UpdateWindowTitle(window, mandelbrot);
+    }
+}
+
+// Once a pixel is less than DOUBLE_FLOAT_ULPS float steps of the view coordinates wide,
+// neighbouring pixels round to the same point and the image turns blocky. The view switches
+// to the double-float variants a little before that and back once it is wide enough again.
+#define DOUBLE_FLOAT_ULPS 8
+
+bool UpdatePrecision(Mandelbrot *mandelbrot, int height) {
+    double size_x = mandelbrot->rect_max[0] - mandelbrot->rect_min[0];
+    double size_y = mandelbrot->rect_max[1] - mandelbrot->rect_min[1];
+    double pixel = (size_x < size_y ? size_x : size_y) / height;
+
+    double magnitude = 0;
+    for (int i = 0; i < 2; ++i) {
+        magnitude = fmax(magnitude, fabs(mandelbrot->rect_min[i]));
+        magnitude = fmax(magnitude, fabs(mandelbrot->rect_max[i]));
+    }
+
+    bool double_float = pixel < DOUBLE_FLOAT_ULPS * FLT_EPSILON * magnitude;
+    if (double_float == mandelbrot->double_float)
+        return false;
+
+    return SelectShaderVariant(mandelbrot, mandelbrot->coloring, mandelbrot->iteration_level, double_float);
+}
+
+double MapRange(double from_x1, double from_x2, double to_x1, double to_x2, double x) {
     return (to_x2 - to_x1) / (from_x2 - from_x1) * (x - from_x1) + to_x1;
 }
 
+// Scales the rect by factor around the point (cx, cy), which stays where it is
+void ZoomRect(Mandelbrot *mandelbrot, double cx, double cy, double factor) {
+    mandelbrot->rect_min[0] -= cx;
+    mandelbrot->rect_max[0] -= cx;
+    mandelbrot->rect_min[1] -= cy;
+    mandelbrot->rect_max[1] -= cy;
+
+    mandelbrot->rect_min[0] *= factor;
+    mandelbrot->rect_max[0] *= factor;
+    mandelbrot->rect_min[1] *= factor;
+    mandelbrot->rect_max[1] *= factor;
+
+    mandelbrot->rect_min[0] += cx;
+    mandelbrot->rect_max[0] += cx;
+    mandelbrot->rect_min[1] += cy;
+    mandelbrot->rect_max[1] += cy;
+}
+
 void HandleScrollEvent(GLFWwindow *window, double scroll_x, double scroll_y) {
     if (scroll_y != 0) {
         Mandelbrot *mandelbrot = (Mandelbrot *)glfwGetWindowUserPointer(window);
@@ -300,28 +820,250 @@ void HandleScrollEvent(GLFWwindow *window, double scroll_x, double scroll_y) {
         int width, height;
         glfwGetFramebufferSize(window, &width, &height);
 
-        float cx = MapRange(0, (float)width, mandelbrot->rect_min[0], mandelbrot->rect_max[0], (float)mouse_x);
-        float cy = MapRange(0, (float)height, mandelbrot->rect_min[1], mandelbrot->rect_max[1], (float)height - (float)mouse_y);
+        double cx = MapRange(0, width, mandelbrot->rect_min[0], mandelbrot->rect_max[0], mouse_x);
+        double cy = MapRange(0, height, mandelbrot->rect_min[1], mandelbrot->rect_max[1], height - mouse_y);
+
+        double factor = scroll_y > 0 ? 0.9 : 1.1;
+        ZoomRect(mandelbrot, cx, cy, factor);
+    }
+}
+
+void InitMandelbrot(Mandelbrot *mandelbrot) {
+    memset(mandelbrot, 0, sizeof(*mandelbrot));
+    mandelbrot->rect_min[0] = -2.0;
+    mandelbrot->rect_min[1] = -2.0;
+    mandelbrot->rect_max[0] = 2.0;
+    mandelbrot->rect_max[1] = 2.0;
+
+    mandelbrot->aspect_ratio = (mandelbrot->rect_max[0] - mandelbrot->rect_min[0]) / (mandelbrot->rect_max[1] - mandelbrot->rect_min[1]);
+}
+
+// The full screen quad every frame is drawn with, stays bound
+void CreateQuad(void) {
+    GLuint vao;
+    glGenVertexArrays(1, &vao);
+    glBindVertexArray(vao);
+
+    GLuint vertex_buffer;
+    glGenBuffers(1, &vertex_buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(g_Vertices), g_Vertices, GL_STATIC_DRAW);
+
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(float) * 2, (void *)0);
+}
+
+void DrawMandelbrot(Mandelbrot *mandelbrot, int width, int height) {
+    glViewport(0, 0, width, height);
+
+    glUseProgram(mandelbrot->shader.id);
+    glUniform2f(mandelbrot->u_resolution, (float)width, (float)height);
+    // the double-float variants get the corner split into the float nearest to it and the rest
+    float min_x = (float)mandelbrot->rect_min[0];
+    float min_y = (float)mandelbrot->rect_min[1];
+    glUniform2f(mandelbrot->u_rect_min, min_x, min_y);
+    glUniform2f(mandelbrot->u_rect_min_lo, (float)(mandelbrot->rect_min[0] - min_x), (float)(mandelbrot->rect_min[1] - min_y));
+    glUniform2f(mandelbrot->u_rect_max, (float)mandelbrot->rect_max[0], (float)mandelbrot->rect_max[1]);
+    glUniform2f(mandelbrot->u_rect_size, (float)(mandelbrot->rect_max[0] - mandelbrot->rect_min[0]),
+                (float)(mandelbrot->rect_max[1] - mandelbrot->rect_min[1]));
+    glUniform1f(mandelbrot->u_time, mandelbrot->time);
+
+    glClearColor(0.2f, 0.2f, 0.2f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    glDrawArrays(GL_TRIANGLES, 0, 6);
+}
 
-        mandelbrot->rect_min[0] -= cx;
-        mandelbrot->rect_max[0] -= cx;
-        mandelbrot->rect_min[1] -= cy;
-        mandelbrot->rect_max[1] -= cy;
+#ifdef _GLFW_OSMESA
+// Headless build: GLFW's null platform with an OSMesa context renders into a buffer in
+// memory, so neither a display nor a GPU is needed. Every frame is timed on its own
+// (glFinish waits for the software rasterizer) and can be dumped as a PPM image, which is
+// enough to benchmark shader variants and diff their output on a build machine.
+
+typedef struct HeadlessOptions {
+    int width;
+    int height;
+    int frames;
+    int coloring;
+    int iteration_level;
+    double zoom;        // rect scale per frame
+    double target[2];   // point the frames zoom into
+    const char *output; // directory for frame_NNNN.ppm, NULL to only time the frames
+} HeadlessOptions;
+
+static void PrintHeadlessUsage(void) {
+    fprintf(stderr,
+        "usage: Mandelbrot-GPU-headless [options]\n"
+        "  --size W H          framebuffer size (default 640 480)\n"
+        "  --frames N          frames to render (default 1)\n"
+        "  --rect X0 Y0 X1 Y1  rect of the first frame (default -2 -2 2 2)\n"
+        "  --zoom F X Y        scale the rect by F around (X, Y) after every frame\n"
+        "  --shader FILE       fragment shader (default mandelbrot.frag)\n"
+        "  --coloring N        1 simple, 2 wave, 3 animated wave, 4 smooth (default 1)\n"
+        "  --iterations N      iteration limit: 100, 200, 500, 1000, 2000 or 5000 (default 500)\n"
+        "  --output DIR        write every frame to DIR/frame_NNNN.ppm\n");
+}
 
-        float factor = scroll_y > 0 ? 0.9f : 1.1f;
+static bool WriteFramePPM(const char *path, const unsigned char *rgba, int width, int height) {
+    FILE *f = fopen(path, "wb");
+    if (!f) return false;
 
-        mandelbrot->rect_min[0] *= factor;
-        mandelbrot->rect_max[0] *= factor;
-        mandelbrot->rect_min[1] *= factor;
-        mandelbrot->rect_max[1] *= factor;
-        
-        mandelbrot->rect_min[0] += cx;
-        mandelbrot->rect_max[0] += cx;
-        mandelbrot->rect_min[1] += cy;
-        mandelbrot->rect_max[1] += cy;
+    fprintf(f, "P6\n%d %d\n255\n", width, height);
+    unsigned char *row = malloc((size_t)width * 3);
+    // glReadPixels starts at the bottom row, the image at the top
+    for (int y = height - 1; y >= 0; --y) {
+        const unsigned char *src = rgba + (size_t)y * width * 4;
+        for (int x = 0; x < width; ++x) {
+            row[x * 3 + 0] = src[x * 4 + 0];
+            row[x * 3 + 1] = src[x * 4 + 1];
+            row[x * 3 + 2] = src[x * 4 + 2];
+        }
+        fwrite(row, 1, (size_t)width * 3, f);
     }
+    free(row);
+
+    return fclose(f) == 0;
 }
 
+int main(int argc, char **argv) {
+    HeadlessOptions options = { 640, 480, 1, COLORING_SIMPLE, DEFAULT_ITERATION_LEVEL, 1.0, { 0.0, 0.0 }, NULL };
+    double rect[4] = { -2.0, -2.0, 2.0, 2.0 };
+
+    for (int i = 1; i < argc; ++i) {
+        int left = argc - i - 1;
+        if (strcmp(argv[i], "--size") == 0 && left >= 2) {
+            options.width = atoi(argv[++i]);
+            options.height = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--frames") == 0 && left >= 1) {
+            options.frames = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--rect") == 0 && left >= 4) {
+            for (int k = 0; k < 4; ++k) rect[k] = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--zoom") == 0 && left >= 3) {
+            options.zoom = atof(argv[++i]);
+            options.target[0] = atof(argv[++i]);
+            options.target[1] = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--shader") == 0 && left >= 1) {
+            FragmentFile = argv[++i];
+        } else if (strcmp(argv[i], "--output") == 0 && left >= 1) {
+            options.output = argv[++i];
+        } else if (strcmp(argv[i], "--coloring") == 0 && left >= 1) {
+            options.coloring = atoi(argv[++i]) - 1;
+        } else if (strcmp(argv[i], "--iterations") == 0 && left >= 1) {
+            int iterations = atoi(argv[++i]);
+            options.iteration_level = -1;
+            for (int level = 0; level < ITERATION_LEVELS; ++level) {
+                if (IterationLevels[level] == iterations) options.iteration_level = level;
+            }
+        } else {
+            PrintHeadlessUsage();
+            return -1;
+        }
+    }
+    if (options.width <= 0 || options.height <= 0 || options.frames <= 0 ||
+        options.coloring < 0 || options.coloring >= COLORING_COUNT || options.iteration_level < 0) {
+        PrintHeadlessUsage();
+        return -1;
+    }
+
+    glfwSetErrorCallback(ErrorCallback);
+
+    if (!glfwInit())
+        return -1;
+
+    // the shaders are #version 420, Mesa only offers that in a core profile
+    glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_OSMESA_CONTEXT_API);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 2);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+
+    GLFWwindow *window = glfwCreateWindow(options.width, options.height, "Mandelbrot-GPU", NULL, NULL);
+    if (!window) {
+        fprintf(stderr, "Failed to create an OSMesa context, is libOSMesa installed?\n");
+        glfwTerminate();
+        return -1;
+    }
+
+    glfwMakeContextCurrent(window);
+
+    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+        fprintf(stderr, "Failed to load opengl functions\n");
+        return -1;
+    }
+
+    printf("%s, %s\n", (const char *)glGetString(GL_RENDERER), (const char *)glGetString(GL_VERSION));
+
+    Mandelbrot mandelbrot;
+    InitMandelbrot(&mandelbrot);
+
+    if (!SelectShaderVariant(&mandelbrot, options.coloring, options.iteration_level, false)) {
+        return -1;
+    }
+
+    mandelbrot.rect_min[0] = rect[0];
+    mandelbrot.rect_min[1] = rect[1];
+    mandelbrot.rect_max[0] = rect[2];
+    mandelbrot.rect_max[1] = rect[3];
+
+    CreateQuad();
+
+    int width, height;
+    glfwGetFramebufferSize(window, &width, &height);
+    unsigned char *pixels = malloc((size_t)width * height * 4);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+
+    // the driver compiles the shader for real on its first draw, that one is not timed
+    UpdatePrecision(&mandelbrot, height);
+    DrawMandelbrot(&mandelbrot, width, height);
+    glFinish();
+
+    double total = 0, fastest = 0, slowest = 0;
+    int result = 0;
+    for (int frame = 0; frame < options.frames; ++frame) {
+        // animated coloring moves on at a fixed rate, the frames do not depend on the timing
+        mandelbrot.time = frame / 30.0f;
+
+        // the zoom went past the precision of float, the new variant gets its untimed draw too
+        if (UpdatePrecision(&mandelbrot, height)) {
+            DrawMandelbrot(&mandelbrot, width, height);
+            glFinish();
+        }
+
+        double start = glfwGetTime();
+        DrawMandelbrot(&mandelbrot, width, height);
+        glFinish();
+        double elapsed = (glfwGetTime() - start) * 1000.0;
+
+        total += elapsed;
+        fastest = (frame == 0 || elapsed < fastest) ? elapsed : fastest;
+        slowest = (frame == 0 || elapsed > slowest) ? elapsed : slowest;
+        printf("frame %4d: %8.3f ms%s\n", frame, elapsed, mandelbrot.double_float ? " (double-float)" : "");
+
+        if (options.output) {
+            char path[1024];
+            snprintf(path, sizeof(path), "%s/frame_%04d.ppm", options.output, frame);
+            glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+            if (!WriteFramePPM(path, pixels, width, height)) {
+                fprintf(stderr, "Failed to write %s\n", path);
+                result = -1;
+                break;
+            }
+        }
+
+        ZoomRect(&mandelbrot, options.target[0], options.target[1], options.zoom);
+    }
+
+    printf("%d frames %dx%d, %s (%s coloring, %d iterations): average %.3f ms, fastest %.3f ms, slowest %.3f ms\n",
+           options.frames, width, height, FragmentFile, ColoringNames[options.coloring],
+           IterationLevels[options.iteration_level], total / options.frames, fastest, slowest);
+
+    free(pixels);
+    glfwDestroyWindow(window);
+    glfwTerminate();
+
+    return result;
+}
+#else
 int main() {
     GLFWwindow *window;
 
@@ -357,63 +1099,61 @@ int main() {
     glfwSwapInterval(1);
 
     Mandelbrot mandelbrot;
+    InitMandelbrot(&mandelbrot);
 
-    if (!LoadShader(&mandelbrot.shader)) {
+    if (!SelectShaderVariant(&mandelbrot, COLORING_SIMPLE, DEFAULT_ITERATION_LEVEL, false)) {
         return -1;
     }
-
-    LoadShaderLocations(&mandelbrot);
-    mandelbrot.rect_min[0] = -2.0f;
-    mandelbrot.rect_min[1] = -2.0f;
-    mandelbrot.rect_max[0] = 2.0f;
-    mandelbrot.rect_max[1] = 2.0f;
-
-    mandelbrot.aspect_ratio = (mandelbrot.rect_max[0] - mandelbrot.rect_min[0]) / (mandelbrot.rect_max[1] - mandelbrot.rect_min[1]);
+    UpdateWindowTitle(window, &mandelbrot);
 
     glfwSetWindowUserPointer(window, &mandelbrot);
     glfwSetScrollCallback(window, HandleScrollEvent);
+    glfwSetKeyCallback(window, HandleKeyEvent);
 
-    GLuint vao;
-    glGenVertexArrays(1, &vao);
-    glBindVertexArray(vao);
+    CreateQuad();
 
-    GLuint vertex_buffer;
-    glGenBuffers(1, &vertex_buffer);
-    glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(g_Vertices), g_Vertices, GL_STATIC_DRAW);
+    ShaderWatcher watcher = { 0 };
+    watcher.v_tmod = mandelbrot.shader.v_tmod;
+    watcher.f_tmod = mandelbrot.shader.f_tmod;
+    watcher.variant = ShaderVariant(mandelbrot.coloring, mandelbrot.iteration_level, mandelbrot.double_float);
 
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(float) * 2, (void *)0);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    watcher.context = glfwCreateWindow(1, 1, "Mandelbrot-GPU shader loader", NULL, window);
+    bool watching = watcher.context && StartShaderWatcher(&watcher);
+    if (watching) {
+        mandelbrot.watcher = &watcher;
+    }
 
     int width, height;
 
     while (!glfwWindowShouldClose(window)) {
         glfwPollEvents();
 
-        if (ReloadShaderIfFileChanged(&mandelbrot.shader)) {
-            LoadShaderLocations(&mandelbrot);
+        if (SwapInWatchedShader(&watcher, &mandelbrot)) {
+            UpdateWindowTitle(window, &mandelbrot);
         }
+        mandelbrot.time = (float)glfwGetTime();
 
         glfwGetFramebufferSize(window, &width, &height);
-
-        glViewport(0, 0, width, height);
-
-        glUseProgram(mandelbrot.shader.id);
-        glUniform2f(mandelbrot.u_resolution, (float)width, (float)height);
-        glUniform2f(mandelbrot.u_rect_min, mandelbrot.rect_min[0], mandelbrot.rect_min[1]);
-        glUniform2f(mandelbrot.u_rect_max, mandelbrot.rect_max[0], mandelbrot.rect_max[1]);
-
-        glClearColor(0.2f, 0.2f, 0.2f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT);
-        
-        glDrawArrays(GL_TRIANGLES, 0, 6);
+        if (UpdatePrecision(&mandelbrot, height)) {
+            UpdateWindowTitle(window, &mandelbrot);
+        }
+        DrawMandelbrot(&mandelbrot, width, height);
 
         glfwSwapBuffers(window);
     }
 
+    if (watching) {
+        StopShaderWatcher(&watcher);
+    }
+    if (watcher.context) {
+        glfwDestroyWindow(watcher.context);
+    }
+
     glfwDestroyWindow(window);
 
     glfwTerminate();
 
     return 0;
 }
+#endif
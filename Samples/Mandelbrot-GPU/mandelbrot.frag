@@ -1,6 +1,24 @@
 #version 420
 
+// MAX_ITERATIONS, COLORING and DOUBLE_FLOAT are defined by the program for every shader variant,
+// the values here are only used when the file is compiled on its own
+#ifndef MAX_ITERATIONS
 #define MAX_ITERATIONS 500
+#endif
+
+#define COLORING_SIMPLE         0
+#define COLORING_WAVE           1
+#define COLORING_WAVE_ANIMATED  2
+#define COLORING_SMOOTH         3
+
+#ifndef COLORING
+#define COLORING COLORING_SIMPLE
+#endif
+
+#ifndef DOUBLE_FLOAT
+#define DOUBLE_FLOAT 0
+#endif
+
 #define cproduct(a, b) vec2(a.x*b.x-a.y*b.y, a.x*b.y+a.y*b.x)
 
 out vec4 FragmentColor;
@@ -8,8 +26,15 @@ out vec4 FragmentColor;
 uniform vec2 u_Resolution;
 uniform vec2 u_RectMin;
 uniform vec2 u_RectMax;
+uniform vec2 u_RectMinLo; // u_RectMin + u_RectMinLo is the corner with double precision
+uniform vec2 u_RectSize;
+uniform float u_Time;
 
+#if COLORING == COLORING_SIMPLE
 float Radius = 10.0f;
+#else
+float Radius = 2.0f;
+#endif
 vec3 ColorWeight = vec3(2.0, 4.0, 5.0);
 
 uint Diverge(inout vec2 c, float radius) {
@@ -23,12 +48,127 @@ uint Diverge(inout vec2 c, float radius) {
 	return iter;
 }
 
+#if DOUBLE_FLOAT
+// Double-float arithmetic: a vec2 (hi, lo) holds the unevaluated sum hi + lo, which carries
+// about 48 bits of mantissa instead of 24. The error terms only survive if the compiler
+// keeps every operation as written, hence precise.
+vec2 QuickTwoSum(float a, float b) {
+	precise float s = a + b;
+	precise float e = b - (s - a);
+	return vec2(s, e);
+}
+
+vec2 TwoSum(float a, float b) {
+	precise float s = a + b;
+	precise float v = s - a;
+	precise float e = (a - (s - v)) + (b - v);
+	return vec2(s, e);
+}
+
+// splits a into two halves of 12 bits, their products with each other are exact floats
+vec2 Split(float a) {
+	precise float t = 4097.0 * a;
+	precise float hi = t - (t - a);
+	return vec2(hi, a - hi);
+}
+
+// fma would be shorter, but drivers are free to compute it unfused and lose the error term
+vec2 TwoProduct(float a, float b) {
+	precise float p = a * b;
+	precise vec2 x = Split(a);
+	precise vec2 y = Split(b);
+	precise float e = ((x.x * y.x - p) + x.x * y.y + x.y * y.x) + x.y * y.y;
+	return vec2(p, e);
+}
+
+vec2 DF_Add(vec2 a, vec2 b) {
+	precise vec2 s = TwoSum(a.x, b.x);
+	s.y += a.y + b.y;
+	return QuickTwoSum(s.x, s.y);
+}
+
+vec2 DF_Mul(vec2 a, vec2 b) {
+	precise vec2 p = TwoProduct(a.x, b.x);
+	p.y += a.x * b.y + a.y * b.x;
+	return QuickTwoSum(p.x, p.y);
+}
+
+// Diverge with the point given as double-floats, c receives the last z rounded to float
+uint DivergeDF(vec2 c_re, vec2 c_im, out vec2 c, float radius) {
+	vec2 z_re = vec2(0, 0);
+	vec2 z_im = vec2(0, 0);
+	uint iter = 0;
+	while (z_re.x * z_re.x + z_im.x * z_im.x <= radius * radius && iter < MAX_ITERATIONS) {
+		vec2 re2 = DF_Mul(z_re, z_re);
+		vec2 im2 = DF_Mul(z_im, z_im);
+		vec2 re_im = DF_Mul(z_re, z_im);
+		z_re = DF_Add(DF_Add(re2, -im2), c_re);
+		z_im = DF_Add(re_im * 2.0, c_im);
+		iter += 1;
+	}
+	c = vec2(z_re.x, z_im.x);
+	return iter;
+}
+#endif
+
+vec3 HSV2RGB(vec3 c) {
+	vec4 K = vec4(1.0, 2.0 / 3.0, 1.0 / 3.0, 3.0);
+	vec3 p = abs(fract(c.xxx + K.xyz) * 6.0 - K.www);
+	return c.z * mix(K.xxx, clamp(p - K.xxx, 0.0, 1.0), c.y);
+}
+
+vec3 SimpleColoring(uint iterations, vec2 z) {
+	float luminance = ((iterations - log2(length(z) / Radius)) / MAX_ITERATIONS);
+	return ColorWeight * luminance;
+}
+
+vec3 WaveColoring(uint iterations, float amount, float time) {
+	float phase = time + amount * iterations;
+	return 0.5 * sin(vec3(phase, phase + 2.094, phase + 4.188)) + 0.5;
+}
+
+vec3 SmoothColoring(uint iterations, vec2 z) {
+	const float Saturation = 1.0;
+	const float Value = 0.8;
+	const float MinHue = 0.1;
+	const float MaxHue = 0.8;
+
+	float smooth_iterations = float(iterations);
+	float value = 0;
+	if (iterations < MAX_ITERATIONS) {
+		float log_zn = log(dot(z, z)) / 2.0;
+		float nu = log(log_zn / log(2.0)) / log(2.0);
+		smooth_iterations += 1.0 - nu;
+		value = Value;
+	}
+
+	float hue = MinHue + (smooth_iterations / MAX_ITERATIONS) * (MaxHue - MinHue);
+	return HSV2RGB(vec3(hue, Saturation, value));
+}
+
 void main() {
 	vec2 st = gl_FragCoord.xy / u_Resolution;
 	float aspect_ratio = u_Resolution.x / u_Resolution.y;
+#if DOUBLE_FLOAT
+	// the offset from the corner is small enough for float, only the sum needs more bits
+	vec2 offset = st * u_RectSize * vec2(aspect_ratio, 1);
+	vec2 c_re = DF_Add(vec2(u_RectMin.x, u_RectMinLo.x), vec2(offset.x, 0));
+	vec2 c_im = DF_Add(vec2(u_RectMin.y, u_RectMinLo.y), vec2(offset.y, 0));
+	vec2 z;
+	uint iterations = DivergeDF(c_re, c_im, z, Radius);
+#else
 	vec2 z = u_RectMin + st * (u_RectMax - u_RectMin) * vec2(aspect_ratio, 1);
 	uint iterations = Diverge(z, Radius);
-	float luminance = ((iterations - log2(length(z) / Radius)) / MAX_ITERATIONS);
-	vec3 color = ColorWeight * luminance;
+#endif
+
+#if COLORING == COLORING_WAVE
+	vec3 color = WaveColoring(iterations, 0.7, 0.0);
+#elif COLORING == COLORING_WAVE_ANIMATED
+	vec3 color = WaveColoring(iterations, 0.07, u_Time);
+#elif COLORING == COLORING_SMOOTH
+	vec3 color = SmoothColoring(iterations, z);
+#else
+	vec3 color = SimpleColoring(iterations, z);
+#endif
 	FragmentColor = vec4(color, 1);
 }
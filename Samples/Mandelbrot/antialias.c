@@ -0,0 +1,254 @@
+#include "mandelbrot.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+Antialias antialias = { 0, 1.0f, SAMPLE_JITTERED };
+
+const char* SamplePatternName(SamplePattern pattern) {
+	switch (pattern) {
+	case SAMPLE_GRID: return "grid";
+	case SAMPLE_JITTERED: return "jittered";
+	case SAMPLE_HALTON: return "halton";
+	default: return "unknown";
+	}
+}
+
+bool AntialiasEnabled(void) {
+	return antialias.samples > 1;
+}
+
+
+typedef struct EdgeJob {
+	const Shade* colors;
+	int width, height;
+	int threshold;			//in shade steps
+	TileOrbits* edges;
+}EdgeJob;
+
+static bool IsEdge(const EdgeJob* job, int x, int y) {
+	const Shade* colors = job->colors;
+	const int width = job->width;
+	const int center = colors[x + y * width];
+	for (int dy = -1; dy <= 1; dy++) {
+		int ny = y + dy;
+		if (ny < 0 || ny >= job->height)
+			continue;
+		for (int dx = -1; dx <= 1; dx++) {
+			int nx = x + dx;
+			if (nx < 0 || nx >= width)
+				continue;
+			int difference = colors[nx + ny * width] - center;
+			if (difference > job->threshold || -difference > job->threshold)
+				return true;
+		}
+	}
+	return false;
+}
+
+static void FindTileEdges(void* data, int item, int worker) {
+	EdgeJob* job = (EdgeJob*)data;
+	Tile tile = TileGet(item, job->width, job->height, TILE_SIZE);
+	TileOrbits* edges = &job->edges[item];
+	edges->count = 0;
+
+	PixelOrbit edge = { 0 };
+	for (int y = tile.y0; y < tile.y1; y++) {
+		for (int x = tile.x0; x < tile.x1; x++) {
+			if (!IsEdge(job, x, y))
+				continue;
+			edge.index = x + y * job->width;
+			TileOrbitsAppend(edges, &edge);
+		}
+	}
+}
+
+void FindEdges(const Shade* colors, int width, int height, TileOrbits* edges) {
+	EdgeJob job;
+	job.colors = colors;
+	job.width = width;
+	job.height = height;
+	//a step below SHADE_INTERIOR keeps interior next to exterior an edge at any threshold
+	job.threshold = (int)minimum(antialias.threshold * SHADE_ONE, SHADE_INTERIOR - 1.0f);
+	job.edges = edges;
+	PoolRun(FindTileEdges, &job, TileCount(width, height, TILE_SIZE));
+}
+
+
+//integer hash (lowbias32), decorrelates the jitter of neighbouring pixels
+static uint32_t Hash(uint32_t x) {
+	x ^= x >> 16;
+	x *= 0x7feb352du;
+	x ^= x >> 15;
+	x *= 0x846ca68bu;
+	x ^= x >> 16;
+	return x;
+}
+
+static float RadicalInverse(int n, int base) {
+	float inverse = 1.0f / base, digit = inverse, result = 0.0f;
+	for (; n > 0; n /= base) {
+		result += (n % base) * digit;
+		digit *= inverse;
+	}
+	return result;
+}
+
+static int SampleCount(int* side) {
+	*side = (int)sqrt((double)antialias.samples);
+	return antialias.pattern == SAMPLE_HALTON ? antialias.samples : *side * *side;
+}
+
+//position of one sample inside pixel index in 1 / ANTIALIAS_SUBPIXELS steps
+static void SampleOffset(int index, int sample, int side, int* x, int* y) {
+	float fx, fy;
+	switch (antialias.pattern) {
+	case SAMPLE_GRID:
+		fx = (sample % side + 0.5f) / side;
+		fy = (sample / side + 0.5f) / side;
+		break;
+	case SAMPLE_JITTERED: {
+		uint32_t h = Hash((uint32_t)index * 0x9e3779b9u + (uint32_t)sample);
+		fx = (sample % side + (h & 0xffff) / 65536.0f) / side;
+		fy = (sample / side + (h >> 16) / 65536.0f) / side;
+		break;
+	}
+	default:
+		//index 0 of the sequence is the pixel corner the first pass already sampled
+		fx = RadicalInverse(sample + 1, 2);
+		fy = RadicalInverse(sample + 1, 3);
+		break;
+	}
+	*x = minimum((int)(fx * ANTIALIAS_SUBPIXELS), ANTIALIAS_SUBPIXELS - 1);
+	*y = minimum((int)(fy * ANTIALIAS_SUBPIXELS), ANTIALIAS_SUBPIXELS - 1);
+}
+
+void EdgeSamplesPrepare(EdgeSamples* samples, const TileOrbits* edges, int tileCount) {
+	int side;
+	int count = 0;
+	for (int i = 0; i < tileCount; i++) {
+		count += edges[i].count;
+	}
+
+	if (count > samples->capacity) {
+		samples->capacity = count > samples->capacity * 3 / 2 ? count : samples->capacity * 3 / 2;
+		samples->pixels = (int*)realloc(samples->pixels, samples->capacity * sizeof(int));
+	}
+	if (tileCount + 1 > samples->tileCapacity) {
+		samples->tileCapacity = tileCount + 1;
+		samples->tileStarts = (int*)realloc(samples->tileStarts, samples->tileCapacity * sizeof(int));
+	}
+	samples->samples = SampleCount(&side);
+	size_t shades = (size_t)count * samples->samples;
+	if (shades > (size_t)samples->shadeCapacity) {
+		samples->shadeCapacity = (int)shades;
+		samples->shades = (Shade*)realloc(samples->shades, shades * sizeof(Shade));
+	}
+
+	samples->count = 0;
+	for (int i = 0; i < tileCount; i++) {
+		samples->tileStarts[i] = samples->count;
+		for (int e = 0; e < edges[i].count; e++) {
+			samples->pixels[samples->count++] = edges[i].items[e].index;
+		}
+	}
+	samples->tileStarts[tileCount] = samples->count;
+	samples->tiles = tileCount;
+}
+
+void SupersampleTile(RenderContext* context, const TileOrbits* edges, Shade* colors, Shade* shades, RenderStats* stats) {
+	//samples are the pixels of a frame ANTIALIAS_SUBPIXELS times finer
+	RenderContext fine = *context;
+	fine.width *= ANTIALIAS_SUBPIXELS;
+	fine.height *= ANTIALIAS_SUBPIXELS;
+
+	int side;
+	const int count = SampleCount(&side);
+	int xs[TILE_SIZE], ys[TILE_SIZE], iterations[TILE_SIZE];
+	Shade batchShades[TILE_SIZE];
+	uint32_t sums[TILE_SIZE];
+	int exterior[TILE_SIZE];
+	//the shortcut counters would count samples instead of pixels
+	RenderStats sampleStats = { 0 };
+
+	for (int begin = 0; begin < edges->count; begin += TILE_SIZE) {
+		const PixelOrbit* batch = edges->items + begin;
+		Shade* runs = shades + (size_t)begin * count;
+		int n = minimum(TILE_SIZE, edges->count - begin);
+		memset(sums, 0, n * sizeof(uint32_t));
+		memset(exterior, 0, n * sizeof(int));
+
+		for (int sample = 0; sample < count; sample++) {
+			for (int i = 0; i < n; i++) {
+				int ox, oy;
+				SampleOffset(batch[i].index, sample, side, &ox, &oy);
+				xs[i] = batch[i].index % context->width * ANTIALIAS_SUBPIXELS + ox;
+				ys[i] = batch[i].index / context->width * ANTIALIAS_SUBPIXELS + oy;
+			}
+			fine.pixels(&fine, xs, ys, n, NULL, iterations, batchShades, &sampleStats);
+			for (int i = 0; i < n; i++) {
+				runs[(size_t)i * count + sample] = batchShades[i];
+				if (batchShades[i] < SHADE_INTERIOR) {
+					sums[i] += batchShades[i];
+					exterior[i] += 1;
+				}
+			}
+		}
+
+		//the color comes from the samples, the shade only has to stay on the right side of the boundary
+		for (int i = 0; i < n; i++) {
+			if (exterior[i] * 2 < count)
+				colors[batch[i].index] = SHADE_INTERIOR;
+			else
+				colors[batch[i].index] = (Shade)((sums[i] + exterior[i] / 2) / exterior[i]);
+		}
+	}
+	stats->supersampled += edges->count;
+}
+
+void ColorizeSamples(const EdgeSamples* samples, const Palette* palette, uint8_t* pixels, int channels) {
+	const int count = samples->samples;
+	for (int p = 0; p < samples->count; p++) {
+		const Shade* run = samples->shades + (size_t)p * count;
+		uint32_t sums[3] = { 0, 0, 0 };
+		for (int i = 0; i < count; i++) {
+			const uint8_t* entry = palette->entries + run[i] * 4;
+			sums[0] += entry[0];
+			sums[1] += entry[1];
+			sums[2] += entry[2];
+		}
+		uint8_t* pixel = pixels + (size_t)samples->pixels[p] * channels;
+		pixel[0] = (uint8_t)((sums[0] + count / 2) / count);
+		pixel[1] = (uint8_t)((sums[1] + count / 2) / count);
+		pixel[2] = (uint8_t)((sums[2] + count / 2) / count);
+	}
+}
+
+void EdgeSamplesCopy(EdgeSamples* to, const EdgeSamples* from) {
+	if (from->count > to->capacity) {
+		to->capacity = from->count > to->capacity * 3 / 2 ? from->count : to->capacity * 3 / 2;
+		to->pixels = (int*)realloc(to->pixels, to->capacity * sizeof(int));
+	}
+	size_t shades = (size_t)from->count * from->samples;
+	if (shades > (size_t)to->shadeCapacity) {
+		to->shadeCapacity = (int)shades;
+		to->shades = (Shade*)realloc(to->shades, shades * sizeof(Shade));
+	}
+	if (from->count) {
+		memcpy(to->pixels, from->pixels, from->count * sizeof(int));
+		memcpy(to->shades, from->shades, shades * sizeof(Shade));
+	}
+	//the tile grouping only matters while sampling
+	to->count = from->count;
+	to->samples = from->samples;
+	to->tiles = 0;
+}
+
+void EdgeSamplesFree(EdgeSamples* samples) {
+	free(samples->pixels);
+	free(samples->shades);
+	free(samples->tileStarts);
+	memset(samples, 0, sizeof(EdgeSamples));
+}
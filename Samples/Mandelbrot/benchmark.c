@@ -0,0 +1,172 @@
+#include "mandelbrot.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+	Kernel benchmark
+
+	Runs every supported escape-time kernel over fixed viewports, resolutions and iteration
+	limits and reports pixel and iteration throughput. Only the kernels are measured: pixel
+	coordinates are computed the same way as for the window, periodicity checks and the
+	interior tests are off, so every pixel costs its full escape time. The checksum covers
+	the iteration counts of the frame and has to be the same for every kernel.
+*/
+
+typedef struct BenchmarkView {
+	const char* name;
+	double centerReal, centerImag, spanReal;
+}BenchmarkView;
+
+static const BenchmarkView benchmarkViews[] = {
+	{ "full", -0.75, 0.0, 3.5 },
+	{ "seahorse", -0.7435, 0.1314, 0.003 },
+	{ "interior", 0.2501, 0.0, 0.004 },		//cusp of the main cardioid: interior and very slow exterior
+	{ "boundary", -1.25066, 0.02012, 0.002 },	//spirals off the period 2 bulb, nearly every pixel is slow exterior
+};
+
+typedef struct BenchmarkJob {
+	EscapeKernel kernel;
+	Complex start, end;
+	int width, height;
+	int maxIterations;
+	int* iterations;
+}BenchmarkJob;
+
+//one row of the frame, in TILE_SIZE pixel chunks like KernelPixels
+static void BenchmarkRow(void* data, int item, int worker) {
+	BenchmarkJob* job = (BenchmarkJob*)data;
+	float cReal[TILE_SIZE], cImag[TILE_SIZE], zReal[TILE_SIZE], zImag[TILE_SIZE];
+	int* iterations = job->iterations + (size_t)item * job->width;
+	float imag = job->start.imag + ((float)item / job->height) * (job->end.imag - job->start.imag);
+
+	for (int begin = 0; begin < job->width; begin += TILE_SIZE) {
+		int n = minimum(TILE_SIZE, job->width - begin);
+		for (int i = 0; i < n; i++) {
+			cReal[i] = job->start.real + ((float)(begin + i) / job->width) * (job->end.real - job->start.real);
+			cImag[i] = imag;
+			zReal[i] = 0.0f;
+			zImag[i] = 0.0f;
+			iterations[begin + i] = 0;
+		}
+		job->kernel(cReal, cImag, zReal, zImag, iterations + begin, n, job->maxIterations, 4.0f, false);
+	}
+}
+
+//FNV-1a over the iteration counts
+static uint64_t Checksum(const int* iterations, size_t count) {
+	uint64_t hash = 14695981039346656037ull;
+	for (size_t i = 0; i < count; i++) {
+		uint32_t value = (uint32_t)iterations[i];
+		for (int k = 0; k < 4; k++) {
+			hash ^= (value >> (8 * k)) & 0xff;
+			hash *= 1099511628211ull;
+		}
+	}
+	return hash;
+}
+
+int BenchmarkMain(int argc, char* argv[]) {
+	int sizes[] = { 512, 1024, 2048 };
+	int limits[] = { 256, 1024, 4096 };
+	int sizeCount = 3, limitCount = 3;
+	const char* only = NULL;
+	int exponent = 2;
+
+	for (int i = 0; i < argc; i++) {
+		if (strcmp(argv[i], "--quick") == 0) {
+			sizes[0] = 256;
+			limits[0] = 256;
+			sizeCount = limitCount = 1;
+		}
+		else if (strcmp(argv[i], "--kernel") == 0 && i + 1 < argc) {
+			only = argv[++i];
+		}
+		else if (strcmp(argv[i], "--exponent") == 0 && i + 1 < argc && atoi(argv[i + 1]) >= 2 && atoi(argv[i + 1]) <= MAX_EXPONENT) {
+			exponent = atoi(argv[++i]);
+		}
+		else {
+			fprintf(stderr, "usage: mandelbrot benchmark [--quick] [--kernel scalar|sse2|avx2|avx512] [--exponent 2-8]\n");
+			return 1;
+		}
+	}
+
+	printf("%d workers, best kernel %s, z^%d + c\n", PoolWorkerCount(), KernelName(BestKernel()), exponent);
+	printf("%-9s %11s %6s %-7s %9s %9s %9s  %-16s\n", "view", "size", "iter", "kernel", "seconds", "Mpix/s", "Giter/s", "checksum");
+
+	int mismatches = 0;
+	size_t capacity = 0;
+	int* iterations = NULL;
+
+	for (int v = 0; v < (int)(sizeof(benchmarkViews) / sizeof(benchmarkViews[0])); v++) {
+		const BenchmarkView* bench = &benchmarkViews[v];
+		for (int s = 0; s < sizeCount; s++) {
+			int width = sizes[s], height = sizes[s];
+			size_t count = (size_t)width * height;
+			if (count > capacity) {
+				capacity = count;
+				iterations = (int*)realloc(iterations, capacity * sizeof(int));
+			}
+
+			Viewport viewport;
+			viewport.centerReal = FixedFromDouble(bench->centerReal);
+			viewport.centerImag = FixedFromDouble(bench->centerImag);
+			viewport.spanReal = bench->spanReal;
+			viewport.spanImag = bench->spanReal * height / width;
+
+			for (int l = 0; l < limitCount; l++) {
+				bool haveReference = false;
+				uint64_t reference = 0;
+
+				for (int k = 0; k < KERNEL_COUNT; k++) {
+					if (!KernelSupported((KernelType)k) || (only && strcmp(only, KernelName((KernelType)k)) != 0))
+						continue;
+
+					BenchmarkJob job;
+					job.kernel = GetPowerKernel((KernelType)k, exponent);
+					job.start = ViewportStart(&viewport);
+					job.end = ViewportEnd(&viewport);
+					job.width = width;
+					job.height = height;
+					job.maxIterations = limits[l];
+					job.iterations = iterations;
+
+					//short runs are repeated and the fastest one counts
+					double best = 0.0, total = 0.0;
+					for (int run = 0; run < 5 && (run == 0 || total < 0.25); run++) {
+						double begin = TimeNow();
+						PoolRun(BenchmarkRow, &job, height);
+						double seconds = TimeNow() - begin;
+						best = run == 0 || seconds < best ? seconds : best;
+						total += seconds;
+					}
+
+					long long iterationSum = 0;
+					for (size_t i = 0; i < count; i++) {
+						iterationSum += iterations[i];
+					}
+					uint64_t checksum = Checksum(iterations, count);
+					bool mismatch = haveReference && checksum != reference;
+					if (!haveReference) {
+						reference = checksum;
+						haveReference = true;
+					}
+					mismatches += mismatch;
+
+					char size[32];
+					snprintf(size, sizeof(size), "%dx%d", width, height);
+					printf("%-9s %11s %6d %-7s %9.4f %9.1f %9.3f  %016llx%s\n", bench->name, size, limits[l],
+						KernelName((KernelType)k), best, count / best * 1e-6, iterationSum / best * 1e-9,
+						(unsigned long long)checksum, mismatch ? " MISMATCH" : "");
+					fflush(stdout);
+				}
+			}
+		}
+	}
+
+	free(iterations);
+	if (mismatches)
+		printf("%d results differ from the first kernel\n", mismatches);
+	return mismatches ? 1 : 0;
+}
@@ -0,0 +1,429 @@
+#include "mandelbrot.h"
+#include "image.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+	Buddhabrot
+
+	Picks random c in the square |real|, |imag| <= 2, iterates z = z^2 + c with the Complex
+	helpers and, when the orbit escapes after at least minIterations, adds every point it
+	visited to a histogram of the view. The density of those points is the image.
+
+	Every worker splats into its own float histogram, so the hot loop never synchronizes;
+	after each round of samples the worker histograms are added to a double total and
+	cleared, which also keeps a round well inside float precision.
+
+	Most random c are wasted: interior points never escape and most exterior ones escape
+	after a few iterations. A coarse pre-pass runs the escape kernels over a grid of cells
+	and counts the probes of every cell that escape within the limits. Cells are then
+	picked with a probability following that count (plus one, so cells the probes missed
+	still get samples) and every splat is weighted by the inverse, which keeps the density
+	unbiased. Cells with no useful probe and no useful neighbour are far from the boundary
+	and rarely give a useful orbit, they keep a small floor probability instead of one.
+	No cell has probability zero, so the estimate stays unbiased; the few splats from such
+	cells carry a large weight and show up as noise until enough samples are taken.
+*/
+
+#define BUDDHABROT_RADIUS 2.0f
+#define SAMPLE_RANGE 2.0			//c is sampled in [-SAMPLE_RANGE, SAMPLE_RANGE] on both axes
+#define IMPORTANCE_CELLS 256		//pre-pass grid, per axis
+#define IMPORTANCE_PROBES 4			//probes per cell, per axis
+#define IMPORTANCE_FLOOR 0.0625		//relative probability of cells far from any useful probe
+#define ITEM_SAMPLES 16384			//samples of one pool item
+#define ROUND_ITEMS_PER_WORKER 16
+
+typedef struct ImportanceMap {
+	int* cells;			//cell indices
+	double* cdf;		//running sum of the cell probabilities
+	float* weights;		//splat weight of every cell, the inverse of its probability
+	int count;
+	int near;			//cells next to a useful probe, the others only get the floor
+}ImportanceMap;
+
+typedef struct BuddhabrotJob {
+	const ImportanceMap* map;
+	int width, height;
+	float scaleX, offsetX, scaleY, offsetY;		//z to histogram coordinates
+	int minIterations;
+	uint64_t seed;
+	long long firstItem;
+	long long samples;		//of the whole render, the last item may be short
+
+	float** histograms;		//one per worker
+	Complex** orbits;		//maxIter points per worker
+	long long* escaped;		//splatted orbits per worker
+	long long* points;		//splatted points per worker
+}BuddhabrotJob;
+
+typedef struct MergeJob {
+	float** histograms;
+	double* total;
+	int width, height;
+}MergeJob;
+
+
+//PCG32, one generator per pool item so the samples do not depend on the scheduling
+static uint32_t Random(uint64_t* state) {
+	uint64_t old = *state;
+	*state = old * 6364136223846793005ull + 1442695040888963407ull;
+	uint32_t shifted = (uint32_t)(((old >> 18) ^ old) >> 27);
+	uint32_t rotation = (uint32_t)(old >> 59);
+	return (shifted >> rotation) | (shifted << ((-rotation) & 31));
+}
+
+static double RandomUnit(uint64_t* state) {
+	return Random(state) * (1.0 / 4294967296.0);
+}
+
+static uint64_t SeedItem(uint64_t seed, long long item) {
+	//splitmix64 of the item, then the first step of the generator
+	uint64_t x = seed + 0x9e3779b97f4a7c15ull * (uint64_t)(item + 1);
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+	x ^= x >> 31;
+	Random(&x);
+	return x;
+}
+
+
+typedef struct ProbeJob {
+	EscapeKernel kernel;
+	int minIterations;
+	int* useful;		//probes per cell that escape within the limits
+}ProbeJob;
+
+//one row of cells
+static void ProbeCells(void* data, int item, int worker) {
+	ProbeJob* job = (ProbeJob*)data;
+	const int probes = IMPORTANCE_CELLS * IMPORTANCE_PROBES;
+	const double step = 2.0 * SAMPLE_RANGE / probes;
+	float cReal[TILE_SIZE], cImag[TILE_SIZE], zReal[TILE_SIZE], zImag[TILE_SIZE];
+	int iterations[TILE_SIZE];
+
+	for (int py = 0; py < IMPORTANCE_PROBES; py++) {
+		float imag = (float)(-SAMPLE_RANGE + ((double)item * IMPORTANCE_PROBES + py + 0.5) * step);
+		for (int begin = 0; begin < probes; begin += TILE_SIZE) {
+			int n = minimum(TILE_SIZE, probes - begin);
+			for (int i = 0; i < n; i++) {
+				cReal[i] = (float)(-SAMPLE_RANGE + (begin + i + 0.5) * step);
+				cImag[i] = imag;
+				zReal[i] = 0.0f;
+				zImag[i] = 0.0f;
+				iterations[i] = 0;
+			}
+			job->kernel(cReal, cImag, zReal, zImag, iterations, n, maxIter, BUDDHABROT_RADIUS, true);
+			for (int i = 0; i < n; i++) {
+				if (iterations[i] >= job->minIterations && iterations[i] < maxIter)
+					job->useful[item * IMPORTANCE_CELLS + (begin + i) / IMPORTANCE_PROBES] += 1;
+			}
+		}
+	}
+}
+
+//without importance every cell is kept with the same weight
+static void BuildImportanceMap(ImportanceMap* map, bool importance, int minIterations) {
+	const int cellCount = IMPORTANCE_CELLS * IMPORTANCE_CELLS;
+	int* useful = (int*)calloc(cellCount, sizeof(int));
+	if (importance) {
+		ProbeJob job;
+		job.kernel = GetKernel(BestKernel());
+		job.minIterations = minIterations;
+		job.useful = useful;
+		PoolRun(ProbeCells, &job, IMPORTANCE_CELLS);
+	}
+
+	map->cells = (int*)malloc(cellCount * sizeof(int));
+	map->cdf = (double*)malloc(cellCount * sizeof(double));
+	map->weights = (float*)malloc(cellCount * sizeof(float));
+	map->count = 0;
+	map->near = 0;
+	double sum = 0.0;
+	for (int y = 0; y < IMPORTANCE_CELLS; y++) {
+		for (int x = 0; x < IMPORTANCE_CELLS; x++) {
+			//a neighbour with useful probes means the boundary passes close by
+			bool near = !importance;
+			for (int dy = -1; dy <= 1 && !near; dy++) {
+				for (int dx = -1; dx <= 1 && !near; dx++) {
+					int nx = x + dx, ny = y + dy;
+					near = nx >= 0 && nx < IMPORTANCE_CELLS && ny >= 0 && ny < IMPORTANCE_CELLS && useful[nx + ny * IMPORTANCE_CELLS];
+				}
+			}
+			int index = x + y * IMPORTANCE_CELLS;
+			double probability = near ? useful[index] + 1.0 : IMPORTANCE_FLOOR;
+			map->near += near ? 1 : 0;
+			sum += probability;
+			map->cells[map->count] = index;
+			map->cdf[map->count] = sum;
+			map->weights[map->count] = (float)probability;
+			map->count += 1;
+		}
+	}
+
+	//probability of a cell is p / sum, its splats count sum / count / p
+	for (int i = 0; i < map->count; i++) {
+		map->weights[i] = (float)(sum / map->count / map->weights[i]);
+	}
+	free(useful);
+}
+
+static int PickCell(const ImportanceMap* map, double u) {
+	double target = u * map->cdf[map->count - 1];
+	int low = 0, high = map->count - 1;
+	while (low < high) {
+		int middle = (low + high) / 2;
+		if (map->cdf[middle] <= target)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+	return low;
+}
+
+
+static void SampleOrbits(void* data, int item, int worker) {
+	BuddhabrotJob* job = (BuddhabrotJob*)data;
+	const ImportanceMap* map = job->map;
+	const long long first = (job->firstItem + item) * ITEM_SAMPLES;
+	const int count = (int)minimum((long long)ITEM_SAMPLES, job->samples - first);
+	const double cellSize = 2.0 * SAMPLE_RANGE / IMPORTANCE_CELLS;
+	const float radius2 = BUDDHABROT_RADIUS * BUDDHABROT_RADIUS;
+	const int width = job->width, height = job->height;
+	float* histogram = job->histograms[worker];
+	Complex* orbit = job->orbits[worker];
+	uint64_t state = SeedItem(job->seed, job->firstItem + item);
+	long long escaped = 0, points = 0;
+
+	for (int s = 0; s < count; s++) {
+		int pick = PickCell(map, RandomUnit(&state));
+		int cell = map->cells[pick];
+		double real = -SAMPLE_RANGE + (cell % IMPORTANCE_CELLS + RandomUnit(&state)) * cellSize;
+		double imag = -SAMPLE_RANGE + (cell / IMPORTANCE_CELLS + RandomUnit(&state)) * cellSize;
+		if (InMainCardioid(real, imag) || InPeriod2Bulb(real, imag))
+			continue;
+
+		//the orbit is kept until it is known to escape late enough
+		Complex c = initComplex((float)real, (float)imag);
+		Complex z = initComplex(0.0f, 0.0f);
+		int n = 0;
+		while (n < maxIter && z.real * z.real + z.imag * z.imag <= radius2) {
+			z = add(multiply(z, z), c);
+			orbit[n++] = z;
+		}
+		if (n >= maxIter || n < job->minIterations)
+			continue;
+
+		const float weight = map->weights[pick];
+		for (int i = 0; i < n; i++) {
+			float x = orbit[i].real * job->scaleX + job->offsetX;
+			float y = orbit[i].imag * job->scaleY + job->offsetY;
+			if (x >= 0.0f && x < width && y >= 0.0f && y < height) {
+				histogram[(int)x + (int)y * width] += weight;
+				points += 1;
+			}
+		}
+		escaped += 1;
+	}
+	job->escaped[worker] += escaped;
+	job->points[worker] += points;
+}
+
+//one band of TILE_SIZE rows, every worker histogram is added and cleared
+static void MergeRows(void* data, int item, int worker) {
+	MergeJob* job = (MergeJob*)data;
+	size_t begin = (size_t)item * TILE_SIZE * job->width;
+	size_t end = (size_t)minimum(job->height, (item + 1) * TILE_SIZE) * job->width;
+	for (int w = 0; w < PoolWorkerCount(); w++) {
+		float* histogram = job->histograms[w];
+		for (size_t i = begin; i < end; i++) {
+			job->total[i] += histogram[i];
+		}
+		memset(histogram + begin, 0, (end - begin) * sizeof(float));
+	}
+}
+
+
+static bool WriteDensity(const char* path, const double* total, int width, int height, double gamma) {
+	ImageWriter* image = ImageOpenDepth(path, width, height, 16);
+	if (!image)
+		return false;
+
+	double peak = 0.0;
+	for (size_t i = 0; i < (size_t)width * height; i++) {
+		if (total[i] > peak)
+			peak = total[i];
+	}
+
+	//gray, the file starts with the top row
+	uint8_t* row = (uint8_t*)malloc((size_t)width * 6);
+	bool ok = true;
+	for (int y = height - 1; y >= 0 && ok; y--) {
+		for (int x = 0; x < width; x++) {
+			double value = peak > 0.0 ? pow(total[x + (size_t)y * width] / peak, 1.0 / gamma) : 0.0;
+			int level = (int)(value * 65535.0 + 0.5);
+			for (int channel = 0; channel < 3; channel++) {
+				row[x * 6 + channel * 2] = (uint8_t)(level >> 8);
+				row[x * 6 + channel * 2 + 1] = (uint8_t)level;
+			}
+		}
+		ok = ImageWriteRows(image, row, 1) != 0;
+	}
+	free(row);
+	return ImageClose(image) && ok;
+}
+
+
+static void PrintUsage(void) {
+	fprintf(stderr,
+		"usage: mandelbrot buddhabrot [options] output.png|output.ppm\n"
+		"  --size WIDTH HEIGHT      image size in pixels (default 1024 1024)\n"
+		"  --center REAL IMAG       view center (default -0.4 0)\n"
+		"  --span WIDTH             view width in the complex plane, the height follows the aspect (default 3.2)\n"
+		"  --samples N              random c values (default 20000000)\n"
+		"  --iterations N           orbits longer than this are interior and not drawn (default 1000)\n"
+		"  --min-iterations N       orbits shorter than this are not drawn (default 20)\n"
+		"  --gamma G                density to brightness exponent 1 / G (default 2)\n"
+		"  --uniform                sample c uniformly instead of from the importance map\n"
+		"  --seed N                 random seed (default 1)\n");
+}
+
+int BuddhabrotMain(int argc, char* argv[]) {
+	int width = 1024, height = 1024;
+	double centerReal = -0.4, centerImag = 0.0, span = 3.2, gamma = 2.0, samples = 2e7;
+	int minIterations = 20, seed = 1;
+	bool importance = true;
+	const char* path = NULL;
+	maxIter = 1000;
+
+	for (int i = 0; i < argc; i++) {
+		const char* arg = argv[i];
+		int left = argc - i - 1;
+		bool ok = true;
+
+		if (strcmp(arg, "--size") == 0 && left >= 2) {
+			ok = ParseInt(argv[i + 1], 1, &width) && ParseInt(argv[i + 2], 1, &height);
+			i += 2;
+		}
+		else if (strcmp(arg, "--center") == 0 && left >= 2) {
+			ok = ParseDouble(argv[i + 1], &centerReal) && ParseDouble(argv[i + 2], &centerImag);
+			i += 2;
+		}
+		else if (strcmp(arg, "--span") == 0 && left >= 1) {
+			ok = ParseDouble(argv[i + 1], &span) && span > 0.0;
+			i += 1;
+		}
+		else if (strcmp(arg, "--samples") == 0 && left >= 1) {
+			ok = ParseDouble(argv[i + 1], &samples) && samples >= 1.0 && samples < 1e15;
+			i += 1;
+		}
+		else if (strcmp(arg, "--iterations") == 0 && left >= 1) {
+			ok = ParseInt(argv[i + 1], 1, &maxIter);
+			i += 1;
+		}
+		else if (strcmp(arg, "--min-iterations") == 0 && left >= 1) {
+			ok = ParseInt(argv[i + 1], 0, &minIterations);
+			i += 1;
+		}
+		else if (strcmp(arg, "--gamma") == 0 && left >= 1) {
+			ok = ParseDouble(argv[i + 1], &gamma) && gamma > 0.0;
+			i += 1;
+		}
+		else if (strcmp(arg, "--uniform") == 0) {
+			importance = false;
+		}
+		else if (strcmp(arg, "--seed") == 0 && left >= 1) {
+			ok = ParseInt(argv[i + 1], 0, &seed);
+			i += 1;
+		}
+		else if (arg[0] != '-' && !path) {
+			path = arg;
+		}
+		else {
+			ok = false;
+		}
+
+		if (!ok) {
+			fprintf(stderr, "buddhabrot: bad argument %s\n", arg);
+			PrintUsage();
+			return 1;
+		}
+	}
+	if (!path || minIterations >= maxIter) {
+		PrintUsage();
+		return 1;
+	}
+
+	double begin = TimeNow();
+	ImportanceMap map;
+	BuildImportanceMap(&map, importance, minIterations);
+	double prepass = TimeNow() - begin;
+	//every cell keeps its floor, so this only means the samples are spread evenly
+	if (importance && map.near == 0)
+		fprintf(stderr, "buddhabrot: no probe escapes between %d and %d iterations, sampling uniformly\n", minIterations, maxIter);
+
+	const int workers = PoolWorkerCount();
+	const size_t pixels = (size_t)width * height;
+	double spanImag = span * height / width;
+	BuddhabrotJob job;
+	job.map = &map;
+	job.width = width;
+	job.height = height;
+	job.scaleX = (float)(width / span);
+	job.offsetX = (float)((0.5 - centerReal / span) * width);
+	job.scaleY = (float)(height / spanImag);
+	job.offsetY = (float)((0.5 - centerImag / spanImag) * height);
+	job.minIterations = minIterations;
+	job.seed = (uint64_t)seed;
+	job.samples = (long long)samples;
+	job.histograms = (float**)malloc(workers * sizeof(float*));
+	job.orbits = (Complex**)malloc(workers * sizeof(Complex*));
+	job.escaped = (long long*)calloc(workers, sizeof(long long));
+	job.points = (long long*)calloc(workers, sizeof(long long));
+	for (int w = 0; w < workers; w++) {
+		job.histograms[w] = (float*)calloc(pixels, sizeof(float));
+		job.orbits[w] = (Complex*)malloc(maxIter * sizeof(Complex));
+	}
+	double* total = (double*)calloc(pixels, sizeof(double));
+
+	MergeJob merge;
+	merge.histograms = job.histograms;
+	merge.total = total;
+	merge.width = width;
+	merge.height = height;
+
+	long long items = (job.samples + ITEM_SAMPLES - 1) / ITEM_SAMPLES;
+	long long roundItems = (long long)workers * ROUND_ITEMS_PER_WORKER;
+	for (job.firstItem = 0; job.firstItem < items; job.firstItem += roundItems) {
+		PoolRun(SampleOrbits, &job, (int)minimum(roundItems, items - job.firstItem));
+		PoolRun(MergeRows, &merge, (height + TILE_SIZE - 1) / TILE_SIZE);
+		fprintf(stderr, "\r%.1f%%", 100.0 * minimum(items, job.firstItem + roundItems) / items);
+	}
+	double seconds = TimeNow() - begin;
+
+	long long escaped = 0, points = 0;
+	for (int w = 0; w < workers; w++) {
+		escaped += job.escaped[w];
+		points += job.points[w];
+		free(job.histograms[w]);
+		free(job.orbits[w]);
+	}
+	bool ok = WriteDensity(path, total, width, height, gamma);
+
+	fprintf(stderr, "\n%s: %d x %d, %lld samples (%.1f%% of the square %s), %.2f s (pre-pass %.2f s, %.1f M samples/s)\n",
+		path, width, height, job.samples, 100.0 * map.near / (IMPORTANCE_CELLS * IMPORTANCE_CELLS),
+		importance ? "near the boundary" : "sampled", seconds, prepass, job.samples / seconds * 1e-6);
+	fprintf(stderr, "%lld orbits drawn (%.2f%%), %lld points%s\n", escaped, 100.0 * escaped / job.samples, points, ok ? "" : ", write failed");
+
+	free(total);
+	free(job.histograms);
+	free(job.orbits);
+	free(job.escaped);
+	free(job.points);
+	free(map.cells);
+	free(map.cdf);
+	free(map.weights);
+	return ok ? 0 : 1;
+}
@@ -1,7 +1,7 @@
 @echo off
 
 setlocal
-set SourceFiles=../../main.c ../../glfw/src/context.c ../../glfw/src/egl_context.c ../../glfw/src/init.c ../../glfw/src/input.c ../../glfw/src/monitor.c ../../glfw/src/osmesa_context.c ../../glfw/src/vulkan.c ../../glfw/src/wgl_context.c ../../glfw/src/win32_init.c ../../glfw/src/win32_joystick.c ../../glfw/src/win32_monitor.c ../../glfw/src/win32_thread.c ../../glfw/src/win32_time.c ../../glfw/src/win32_window.c ../../glfw/src/window.c
+set SourceFiles=../../main.c ../../mandelbrot.c ../../kernels.c ../../deepzoom.c ../../subdivide.c ../../distance.c ../../antialias.c ../../equalize.c ../../poster.c ../../image.c ../../benchmark.c ../../buddhabrot.c ../../server.c ../../zoom.c ../../renderer.c ../../threads.c ../../glfw/src/context.c ../../glfw/src/egl_context.c ../../glfw/src/init.c ../../glfw/src/input.c ../../glfw/src/monitor.c ../../glfw/src/osmesa_context.c ../../glfw/src/vulkan.c ../../glfw/src/wgl_context.c ../../glfw/src/win32_init.c ../../glfw/src/win32_joystick.c ../../glfw/src/win32_monitor.c ../../glfw/src/win32_thread.c ../../glfw/src/win32_time.c ../../glfw/src/win32_window.c ../../glfw/src/window.c
 
 set CLFlags=-Od
 set CLANGFlags=-g -gcodeview
@@ -28,7 +28,7 @@ if %ERRORLEVEL% neq 0 goto SkipMSVC
 echo Building with Msvc
 if not exist "bin\MsvcBuild" mkdir bin\MsvcBuild
 pushd bin\MsvcBuild
-call cl -nologo -D_CRT_SECURE_NO_WARNINGS -D_GLFW_WIN32 -nologo -Zi -EHsc %CLFlags% %SourceFiles% -Femandelbrot.exe /link user32.lib gdi32.lib shell32.lib opengl32.lib
+call cl -nologo -D_CRT_SECURE_NO_WARNINGS -D_GLFW_WIN32 -nologo -Zi -EHsc %CLFlags% %SourceFiles% -Femandelbrot.exe /link user32.lib gdi32.lib shell32.lib opengl32.lib ws2_32.lib
 popd
 echo -------------------------------------
 goto CLANG
@@ -42,7 +42,7 @@ IF %ERRORLEVEL% NEQ 0 goto SkipCLANG
 echo Building with CLANG
 if not exist "bin\ClangBuild" mkdir bin\ClangBuild
 pushd bin\ClangBuild
-call clang -Wno-switch -Wno-pointer-sign -Wno-enum-conversion -D_CRT_SECURE_NO_WARNINGS -D_GLFW_WIN32 %CLANGFlags% %SourceFiles% -o mandelbrot.exe -luser32.lib -lgdi32.lib -lshell32.lib -lopengl32.lib
+call clang -Wno-switch -Wno-pointer-sign -Wno-enum-conversion -D_CRT_SECURE_NO_WARNINGS -D_GLFW_WIN32 %CLANGFlags% %SourceFiles% -o mandelbrot.exe -luser32.lib -lgdi32.lib -lshell32.lib -lopengl32.lib -lws2_32.lib
 popd
 echo -------------------------------------
 goto GCC
@@ -58,7 +58,7 @@ IF %ERRORLEVEL% NEQ 0 goto SkipGCC
 echo Building with GCC
 if not exist "bin\GccBuild" mkdir bin\GccBuild
 pushd bin\GccBuild
-call gcc -Wno-switch -Wno-pointer-sign -Wno-enum-conversion -D_CRT_SECURE_NO_WARNINGS -D_GLFW_WIN32 %GCCFlags% %SourceFiles% -o mandelbrot.exe -luser32 -lgdi32 -lshell32 -lopengl32
+call gcc -Wno-switch -Wno-pointer-sign -Wno-enum-conversion -D_CRT_SECURE_NO_WARNINGS -D_GLFW_WIN32 %GCCFlags% %SourceFiles% -o mandelbrot.exe -luser32 -lgdi32 -lshell32 -lopengl32 -lws2_32
 popd
 echo -------------------------------------
 goto Finished
@@ -0,0 +1,356 @@
+#include "mandelbrot.h"
+
+#include <ctype.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+	Fixed point arithmetic
+*/
+
+#define FIXED_FRACTION_LIMBS (FIXED_LIMBS - 1)
+
+static bool FixedIsNegative(Fixed x) {
+	return (x.limb[FIXED_LIMBS - 1] & 0x80000000u) != 0;
+}
+
+static Fixed FixedNegate(Fixed x) {
+	uint64_t carry = 1;
+	for (int i = 0; i < FIXED_LIMBS; i++) {
+		uint64_t sum = (uint64_t)(~x.limb[i]) + carry;
+		x.limb[i] = (uint32_t)sum;
+		carry = sum >> 32;
+	}
+	return x;
+}
+
+Fixed FixedFromDouble(double x) {
+	Fixed result = { 0 };
+	double magnitude = fabs(x);
+	double whole = floor(magnitude);
+	double fraction = magnitude - whole;
+
+	result.limb[FIXED_LIMBS - 1] = (uint32_t)whole;
+	for (int i = FIXED_LIMBS - 2; i >= 0 && fraction > 0.0; i--) {
+		fraction *= 4294967296.0;
+		double digit = floor(fraction);
+		result.limb[i] = (uint32_t)digit;
+		fraction -= digit;
+	}
+
+	return x < 0.0 ? FixedNegate(result) : result;
+}
+
+double FixedToDouble(Fixed x) {
+	bool negative = FixedIsNegative(x);
+	if (negative)
+		x = FixedNegate(x);
+
+	double result = 0.0;
+	double scale = 1.0;
+	for (int i = FIXED_LIMBS - 1; i >= 0; i--) {
+		result += x.limb[i] * scale;
+		scale /= 4294967296.0;
+	}
+	return negative ? -result : result;
+}
+
+Fixed FixedAdd(Fixed a, Fixed b) {
+	Fixed result;
+	uint64_t carry = 0;
+	for (int i = 0; i < FIXED_LIMBS; i++) {
+		uint64_t sum = (uint64_t)a.limb[i] + b.limb[i] + carry;
+		result.limb[i] = (uint32_t)sum;
+		carry = sum >> 32;
+	}
+	return result;
+}
+
+Fixed FixedSub(Fixed a, Fixed b) {
+	return FixedAdd(a, FixedNegate(b));
+}
+
+Fixed FixedMul(Fixed a, Fixed b) {
+	bool negative = FixedIsNegative(a) != FixedIsNegative(b);
+	if (FixedIsNegative(a))
+		a = FixedNegate(a);
+	if (FixedIsNegative(b))
+		b = FixedNegate(b);
+
+	//schoolbook product of the magnitudes, the low fraction limbs are dropped afterwards
+	uint32_t product[2 * FIXED_LIMBS] = { 0 };
+	for (int i = 0; i < FIXED_LIMBS; i++) {
+		uint64_t carry = 0;
+		for (int j = 0; j < FIXED_LIMBS; j++) {
+			uint64_t t = (uint64_t)a.limb[i] * b.limb[j] + product[i + j] + carry;
+			product[i + j] = (uint32_t)t;
+			carry = t >> 32;
+		}
+		product[i + FIXED_LIMBS] = (uint32_t)carry;
+	}
+
+	Fixed result;
+	for (int i = 0; i < FIXED_LIMBS; i++) {
+		result.limb[i] = product[i + FIXED_FRACTION_LIMBS];
+	}
+	return negative ? FixedNegate(result) : result;
+}
+
+bool FixedParse(const char* text, Fixed* result) {
+	if (strpbrk(text, "eE")) {
+		char* end;
+		double value = strtod(text, &end);
+		if (end == text || *end)
+			return false;
+		*result = FixedFromDouble(value);
+		return true;
+	}
+
+	const char* p = text;
+	bool negative = *p == '-';
+	if (*p == '-' || *p == '+')
+		p++;
+
+	Fixed value = { 0 };
+	int digits = 0;
+	while (isdigit((unsigned char)*p)) {
+		value.limb[FIXED_LIMBS - 1] = value.limb[FIXED_LIMBS - 1] * 10 + (*p - '0');
+		digits++;
+		p++;
+	}
+
+	const char* fraction = p;
+	if (*p == '.') {
+		fraction = ++p;
+		while (isdigit((unsigned char)*p)) {
+			digits++;
+			p++;
+		}
+	}
+	if (*p || digits == 0)
+		return false;
+
+	//fraction digits from the last one: f = (digit + f) / 10
+	Fixed part = { 0 };
+	for (const char* d = p - 1; d >= fraction; d--) {
+		part.limb[FIXED_LIMBS - 1] = *d - '0';
+		uint64_t remainder = 0;
+		for (int i = FIXED_LIMBS - 1; i >= 0; i--) {
+			uint64_t current = (remainder << 32) | part.limb[i];
+			part.limb[i] = (uint32_t)(current / 10);
+			remainder = current % 10;
+		}
+	}
+	value = FixedAdd(value, part);
+
+	*result = negative ? FixedNegate(value) : value;
+	return true;
+}
+
+
+/*
+	Reference orbit and per pixel perturbation
+*/
+
+PerturbationStats perturbationStats;
+
+typedef struct ReferenceOrbit {
+	double* real;
+	double* imag;
+	int length;
+	int capacity;
+
+	//what the orbit was computed for, refinement passes reuse it
+	Fixed cReal, cImag;
+	int maxIterations;
+	double radius;
+
+	//last point, a higher limit continues from here unless the orbit escaped
+	Fixed zReal, zImag;
+	bool escaped;
+}ReferenceOrbit;
+
+static ReferenceOrbit reference;
+
+static void ComputeReferenceOrbit(Fixed cReal, Fixed cImag, int maxIterations, double radius) {
+	bool same = reference.length && reference.radius == radius &&
+		memcmp(&reference.cReal, &cReal, sizeof(Fixed)) == 0 && memcmp(&reference.cImag, &cImag, sizeof(Fixed)) == 0;
+	if (same && (reference.escaped || reference.maxIterations >= maxIterations))
+		return;
+
+	if (reference.capacity < maxIterations + 1) {
+		reference.capacity = maxIterations + 1;
+		reference.real = (double*)realloc(reference.real, reference.capacity * sizeof(double));
+		reference.imag = (double*)realloc(reference.imag, reference.capacity * sizeof(double));
+	}
+
+	//a raised limit on the same orbit only adds the missing points
+	int n = 0;
+	Fixed zReal = { 0 }, zImag = { 0 };
+	if (same) {
+		n = reference.length;
+		zReal = reference.zReal;
+		zImag = reference.zImag;
+	}
+	else {
+		reference.cReal = cReal;
+		reference.cImag = cImag;
+		reference.radius = radius;
+		reference.escaped = false;
+		reference.length = 0;
+	}
+	reference.maxIterations = maxIterations;
+
+	for (; n <= maxIterations; n++) {
+		if (n > 0) {
+			Fixed real2 = FixedMul(zReal, zReal);
+			Fixed imag2 = FixedMul(zImag, zImag);
+			Fixed realImag = FixedMul(zReal, zImag);
+			zReal = FixedAdd(FixedSub(real2, imag2), cReal);
+			zImag = FixedAdd(FixedAdd(realImag, realImag), cImag);
+		}
+
+		double real = FixedToDouble(zReal);
+		double imag = FixedToDouble(zImag);
+		reference.real[n] = real;
+		reference.imag[n] = imag;
+		reference.length = n + 1;
+
+		if (real * real + imag * imag > radius * radius) {
+			reference.escaped = true;
+			break;
+		}
+	}
+	reference.zReal = zReal;
+	reference.zImag = zImag;
+}
+
+
+static void PerturbationPixels(RenderContext* context, const int* xs, const int* ys, int count, PixelOrbit* orbits, int* iterations, Shade* colors, RenderStats* stats) {
+	const double* refReal = context->refReal;
+	const double* refImag = context->refImag;
+	const int last = context->refLength - 1;
+	const double radius = context->radius;
+	const double radius2 = radius * radius;
+	//neighbouring pixels have orbits about a pixel apart, the cycle test must not merge them
+	const double pixel = context->spanReal / context->width;
+	const double epsilon = minimum(PERIODICITY_EPSILON, pixel * pixel);
+
+	for (int i = 0; i < count; i++) {
+		double dcReal = ((double)xs[i] / context->width - 0.5) * context->spanReal;
+		double dcImag = ((double)ys[i] / context->height - 0.5) * context->spanImag;
+
+		//the derivative is not kept, distance estimation always starts at z = 0
+		PixelOrbit* orbit = orbits && !context->distance ? &orbits[i] : NULL;
+		bool interior = orbit && orbit->reference == ORBIT_INTERIOR;
+		if (!interior && context->shortcuts) {
+			double real = context->centerReal + dcReal, imag = context->centerImag + dcImag;
+			bool cardioid = InMainCardioid(real, imag);
+			if (cardioid || InPeriod2Bulb(real, imag)) {
+				if (cardioid)
+					stats->cardioid += 1;
+				else
+					stats->bulb += 1;
+				interior = true;
+			}
+		}
+		if (interior) {
+			if (orbit) {
+				orbit->iterations = maxIter;
+				orbit->reference = ORBIT_INTERIOR;
+			}
+			iterations[i] = maxIter;
+			colors[i] = SHADE_INTERIOR;
+			continue;
+		}
+
+		double dzReal = orbit ? orbit->zReal : 0.0, dzImag = orbit ? orbit->zImag : 0.0;
+		double zReal = 0.0, zImag = 0.0;
+		double derReal = 0.0, derImag = 0.0;
+		int m = orbit ? orbit->reference : 0;
+		int iter = orbit ? orbit->iterations : 0;
+		bool periodic = false;
+
+		double checkReal = refReal[m] + dzReal, checkImag = refImag[m] + dzImag;
+		int step = 0, nextCheck = 1;
+
+		for (;;) {
+			zReal = refReal[m] + dzReal;
+			zImag = refImag[m] + dzImag;
+			double magnitude2 = zReal * zReal + zImag * zImag;
+			if (magnitude2 > radius2 || iter >= maxIter)
+				break;
+
+			//glitch or end of the reference orbit: continue from the start of the orbit
+			if (magnitude2 < dzReal * dzReal + dzImag * dzImag || m == last) {
+				dzReal = zReal;
+				dzImag = zImag;
+				m = 0;
+				stats->rebases += 1;
+			}
+
+			//dz/dc = 2 z dz/dc + 1 on the full orbit
+			if (context->distance) {
+				double real = 2.0 * (zReal * derReal - zImag * derImag) + 1.0;
+				derImag = 2.0 * (zReal * derImag + zImag * derReal);
+				derReal = real;
+			}
+
+			double Zr = refReal[m], Zi = refImag[m];
+			double real = 2.0 * (Zr * dzReal - Zi * dzImag) + (dzReal * dzReal - dzImag * dzImag) + dcReal;
+			double imag = 2.0 * (Zr * dzImag + Zi * dzReal) + 2.0 * dzReal * dzImag + dcImag;
+			dzReal = real;
+			dzImag = imag;
+			m += 1;
+			iter += 1;
+
+			//Brent cycle detection on the full orbit Z + dz, see EscapeKernel
+			if (!context->shortcuts)
+				continue;
+			step += 1;
+			double distReal = refReal[m] + dzReal - checkReal, distImag = refImag[m] + dzImag - checkImag;
+			if (distReal * distReal + distImag * distImag < epsilon && iter < maxIter) {
+				iter = maxIter;
+				periodic = true;
+				stats->periodic += 1;
+				break;
+			}
+			if (step == nextCheck) {
+				checkReal = refReal[m] + dzReal;
+				checkImag = refImag[m] + dzImag;
+				nextCheck *= 2;
+			}
+		}
+
+		iterations[i] = iter;
+		if (orbit) {
+			orbit->iterations = iter;
+			orbit->reference = periodic ? ORBIT_INTERIOR : m;
+			orbit->zReal = dzReal;
+			orbit->zImag = dzImag;
+		}
+		if (iter >= maxIter) {
+			colors[i] = SHADE_INTERIOR;
+			continue;
+		}
+		double magnitude = sqrt(zReal * zReal + zImag * zImag);
+		if (context->distance)
+			colors[i] = DistanceShade(magnitude, sqrt(derReal * derReal + derImag * derImag), context->pixelWidth);
+		else
+			colors[i] = ShadeFromValue((float)((iter - log2(magnitude / radius)) / maxIter) * 255);
+	}
+}
+
+void PerturbationBegin(RenderContext* context, const Viewport* viewport) {
+	ComputeReferenceOrbit(viewport->centerReal, viewport->centerImag, maxIter, context->radius);
+
+	context->pixels = PerturbationPixels;
+	context->refReal = reference.real;
+	context->refImag = reference.imag;
+	context->refLength = reference.length;
+}
+
+void PerturbationEnd(RenderContext* context) {
+	perturbationStats.referenceLength = context->refLength;
+}
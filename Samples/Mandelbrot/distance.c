@@ -0,0 +1,92 @@
+#include "mandelbrot.h"
+
+#include <math.h>
+
+
+Shade DistanceShade(double magnitude, double derivative, double pixel) {
+	if (!(derivative > 0.0))
+		return 0;
+	//distance in pixels, the boundary gets about as bright as slowly escaping pixels do and
+	//the glow falls off away from it; the interior keeps SHADE_INTERIOR so it stays apart
+	double pixels = 0.5 * magnitude * log(magnitude) / derivative / pixel;
+	return ShadeFromValue((float)(DISTANCE_BRIGHTNESS / sqrt(1.0 + pixels)));
+}
+
+void DistancePixels(RenderContext* context, const int* xs, const int* ys, int count, PixelOrbit* orbits, int* iterations, Shade* colors, RenderStats* stats) {
+	const double radius2 = (double)context->radius * context->radius;
+	const double pixel = context->pixelWidth;
+	const int exponent = context->exponent;
+
+	for (int i = 0; i < count; i++) {
+		double real = context->centerReal + ((double)xs[i] / context->width - 0.5) * context->spanReal;
+		double imag = context->centerImag + ((double)ys[i] / context->height - 0.5) * context->spanImag;
+
+		if (context->interiorTests) {
+			bool cardioid = InMainCardioid(real, imag);
+			if (cardioid || InPeriod2Bulb(real, imag)) {
+				if (cardioid)
+					stats->cardioid += 1;
+				else
+					stats->bulb += 1;
+				iterations[i] = maxIter;
+				colors[i] = SHADE_INTERIOR;
+				continue;
+			}
+		}
+
+		//Mandelbrot sets differentiate by c starting from z = 0, Julia sets by the start value
+		double cReal = real, cImag = imag, zReal = 0.0, zImag = 0.0, dzReal = 0.0, dzImag = 0.0, offset = 1.0;
+		if (context->julia) {
+			cReal = context->juliaC.real;
+			cImag = context->juliaC.imag;
+			zReal = real;
+			zImag = imag;
+			dzReal = 1.0;
+			offset = 0.0;
+		}
+
+		double checkReal = zReal, checkImag = zImag;
+		int step = 0, nextCheck = 1;
+		int iter = 0;
+
+		while (zReal * zReal + zImag * zImag <= radius2 && iter < maxIter) {
+			//p = z^(n-1), then dz = n p dz + offset and z = p z + c
+			double pReal = zReal, pImag = zImag;
+			for (int k = 2; k < exponent; k++) {
+				double t = pReal * zReal - pImag * zImag;
+				pImag = pReal * zImag + pImag * zReal;
+				pReal = t;
+			}
+			double nextReal = exponent * (pReal * dzReal - pImag * dzImag) + offset;
+			dzImag = exponent * (pReal * dzImag + pImag * dzReal);
+			dzReal = nextReal;
+			nextReal = pReal * zReal - pImag * zImag + cReal;
+			zImag = pReal * zImag + pImag * zReal + cImag;
+			zReal = nextReal;
+			iter += 1;
+
+			//Brent cycle detection, see EscapeKernel
+			if (!context->shortcuts)
+				continue;
+			step += 1;
+			double distReal = zReal - checkReal, distImag = zImag - checkImag;
+			if (distReal * distReal + distImag * distImag < PERIODICITY_EPSILON && iter < maxIter) {
+				iter = maxIter;
+				stats->periodic += 1;
+				break;
+			}
+			if (step == nextCheck) {
+				checkReal = zReal;
+				checkImag = zImag;
+				nextCheck *= 2;
+			}
+		}
+
+		iterations[i] = iter;
+		if (iter >= maxIter) {
+			colors[i] = SHADE_INTERIOR;
+			continue;
+		}
+		colors[i] = DistanceShade(sqrt(zReal * zReal + zImag * zImag), sqrt(dzReal * dzReal + dzImag * dzImag), pixel);
+	}
+}
@@ -0,0 +1,85 @@
+#include "mandelbrot.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+
+#define RANGE_LEVELS (SHADE_LEVELS / HISTOGRAM_RANGES)
+
+typedef struct HistogramJob {
+	Histogram* histogram;
+	const Shade* colors;
+	int width, height;
+}HistogramJob;
+
+//one band of TILE_SIZE rows into the histogram of the worker
+static void CountRows(void* data, int item, int worker) {
+	HistogramJob* job = (HistogramJob*)data;
+	uint32_t* counts = job->histogram->counts + (size_t)worker * SHADE_LEVELS;
+	const Shade* colors = job->colors + (size_t)item * TILE_SIZE * job->width;
+	const Shade* end = job->colors + (size_t)minimum(job->height, (item + 1) * TILE_SIZE) * job->width;
+	for (; colors < end; colors++) {
+		counts[*colors] += 1;
+	}
+}
+
+//adds up one range of every worker histogram, clears them for the next frame and sums the range
+static void MergeRange(void* data, int item, int worker) {
+	Histogram* histogram = ((HistogramJob*)data)->histogram;
+	uint32_t* cumulative = histogram->cumulative;
+	uint32_t sum = 0;
+	for (int shade = item * RANGE_LEVELS; shade < (item + 1) * RANGE_LEVELS; shade++) {
+		uint32_t count = 0;
+		for (int w = 0; w < histogram->workers; w++) {
+			uint32_t* counts = histogram->counts + (size_t)w * SHADE_LEVELS;
+			count += counts[shade];
+			counts[shade] = 0;
+		}
+		//the interior keeps its own color and stays out of the distribution
+		if (shade < SHADE_INTERIOR)
+			sum += count;
+		cumulative[shade] = sum;
+	}
+	histogram->rangeSums[item] = sum;
+}
+
+static void OffsetRange(void* data, int item, int worker) {
+	Histogram* histogram = ((HistogramJob*)data)->histogram;
+	uint32_t offset = histogram->rangeSums[item];
+	uint32_t* cumulative = histogram->cumulative + item * RANGE_LEVELS;
+	for (int i = 0; i < RANGE_LEVELS && offset; i++) {
+		cumulative[i] += offset;
+	}
+}
+
+void HistogramCount(Histogram* histogram, const Shade* colors, int width, int height) {
+	if (!histogram->counts) {
+		histogram->workers = PoolWorkerCount();
+		histogram->counts = (uint32_t*)calloc((size_t)histogram->workers * SHADE_LEVELS, sizeof(uint32_t));
+		histogram->cumulative = (uint32_t*)malloc(SHADE_LEVELS * sizeof(uint32_t));
+	}
+
+	HistogramJob job;
+	job.histogram = histogram;
+	job.colors = colors;
+	job.width = width;
+	job.height = height;
+	PoolRun(CountRows, &job, (height + TILE_SIZE - 1) / TILE_SIZE);
+	PoolRun(MergeRange, &job, HISTOGRAM_RANGES);
+
+	//range sums become the counts below every range, then every range adds its own
+	uint32_t below = 0;
+	for (int i = 0; i < HISTOGRAM_RANGES; i++) {
+		uint32_t sum = histogram->rangeSums[i];
+		histogram->rangeSums[i] = below;
+		below += sum;
+	}
+	PoolRun(OffsetRange, &job, HISTOGRAM_RANGES);
+	histogram->total = below;
+}
+
+void HistogramFree(Histogram* histogram) {
+	free(histogram->counts);
+	free(histogram->cumulative);
+	memset(histogram, 0, sizeof(Histogram));
+}
@@ -0,0 +1,384 @@
+#include "image.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+	PNG output
+
+	The whole image is one zlib stream made of a single fixed Huffman deflate block that is
+	extended row by row and split into IDAT chunks as the compressed bytes come out. Every
+	row gets the PNG filter with the smallest sum of absolute residuals. Matches are looked
+	for with a hash of the next three bytes and a short chain of earlier positions, which
+	handles the long flat runs of poster images well without a full deflate implementation.
+*/
+
+#define WINDOW_SIZE 32768		//largest deflate match distance
+#define HASH_BITS 15
+#define HASH_SIZE (1 << HASH_BITS)
+#define MAX_CHAIN 16			//candidates tried per position
+#define MIN_MATCH 3
+#define MAX_MATCH 258
+#define CHUNK_SIZE 65536		//compressed bytes per IDAT chunk
+
+struct ImageWriter {
+	FILE* file;
+	int width, height;
+	int rowsWritten;
+	int png;
+	int failed;
+	int pixelSize;				//bytes per pixel, 3 or 6
+
+	//filtering, rows are pixelSize * width bytes
+	uint8_t* previous;			//unfiltered previous row, zeros before the first one
+	uint8_t* filtered;			//filter type byte followed by the filtered row
+	uint8_t* trial;
+
+	//deflate
+	uint8_t window[2 * WINDOW_SIZE];
+	int windowFill;
+	int64_t windowStart;		//stream position of window[0]
+	int64_t head[HASH_SIZE];	//latest position per hash, -1 when none
+	int64_t chain[WINDOW_SIZE];	//previous position with the same hash
+	uint32_t bitBuffer;
+	int bitCount;
+	uint32_t adler;
+
+	uint8_t chunk[CHUNK_SIZE];
+	int chunkFill;
+	uint32_t crcTable[256];
+};
+
+
+static void WriteBytes(ImageWriter* image, const void* data, size_t size) {
+	if (fwrite(data, 1, size, image->file) != size)
+		image->failed = 1;
+}
+
+static void WriteUint32(ImageWriter* image, uint32_t value) {
+	uint8_t bytes[4] = { (uint8_t)(value >> 24), (uint8_t)(value >> 16), (uint8_t)(value >> 8), (uint8_t)value };
+	WriteBytes(image, bytes, 4);
+}
+
+static uint32_t UpdateCrc(const ImageWriter* image, uint32_t crc, const uint8_t* data, int size) {
+	for (int i = 0; i < size; i++) {
+		crc = image->crcTable[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+	}
+	return crc;
+}
+
+static void WriteChunk(ImageWriter* image, const char* type, const uint8_t* data, int size) {
+	WriteUint32(image, (uint32_t)size);
+	WriteBytes(image, type, 4);
+	WriteBytes(image, data, size);
+	uint32_t crc = UpdateCrc(image, 0xffffffffu, (const uint8_t*)type, 4);
+	crc = UpdateCrc(image, crc, data, size);
+	WriteUint32(image, crc ^ 0xffffffffu);
+}
+
+static uint32_t UpdateAdler(uint32_t adler, const uint8_t* data, int size) {
+	uint32_t a = adler & 0xffff, b = adler >> 16;
+	while (size > 0) {
+		//5552 bytes is the most that cannot overflow b before the modulo
+		int n = size < 5552 ? size : 5552;
+		for (int i = 0; i < n; i++) {
+			a += data[i];
+			b += a;
+		}
+		a %= 65521;
+		b %= 65521;
+		data += n;
+		size -= n;
+	}
+	return a | (b << 16);
+}
+
+
+static void FlushChunk(ImageWriter* image) {
+	if (image->chunkFill == 0)
+		return;
+	WriteChunk(image, "IDAT", image->chunk, image->chunkFill);
+	image->chunkFill = 0;
+}
+
+static void PutByte(ImageWriter* image, uint8_t byte) {
+	image->chunk[image->chunkFill++] = byte;
+	if (image->chunkFill == CHUNK_SIZE)
+		FlushChunk(image);
+}
+
+//deflate packs bits starting with the least significant one
+static void PutBits(ImageWriter* image, uint32_t bits, int count) {
+	image->bitBuffer |= bits << image->bitCount;
+	image->bitCount += count;
+	while (image->bitCount >= 8) {
+		PutByte(image, (uint8_t)image->bitBuffer);
+		image->bitBuffer >>= 8;
+		image->bitCount -= 8;
+	}
+}
+
+//Huffman codes are stored most significant bit first
+static uint32_t ReverseBits(uint32_t code, int length) {
+	uint32_t result = 0;
+	for (int i = 0; i < length; i++) {
+		result = (result << 1) | (code & 1);
+		code >>= 1;
+	}
+	return result;
+}
+
+static void PutSymbol(ImageWriter* image, int symbol) {
+	if (symbol < 144)
+		PutBits(image, ReverseBits(0x30 + symbol, 8), 8);
+	else if (symbol < 256)
+		PutBits(image, ReverseBits(0x190 + symbol - 144, 9), 9);
+	else if (symbol < 280)
+		PutBits(image, ReverseBits(symbol - 256, 7), 7);
+	else
+		PutBits(image, ReverseBits(0xc0 + symbol - 280, 8), 8);
+}
+
+static const int lengthBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const int lengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const int distanceBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const int distanceExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+static void PutMatch(ImageWriter* image, int length, int distance) {
+	int code = 28;
+	while (lengthBase[code] > length) {
+		code--;
+	}
+	PutSymbol(image, 257 + code);
+	PutBits(image, length - lengthBase[code], lengthExtra[code]);
+
+	code = 29;
+	while (distanceBase[code] > distance) {
+		code--;
+	}
+	PutBits(image, ReverseBits(code, 5), 5);	//fixed distance codes are all 5 bits
+	PutBits(image, distance - distanceBase[code], distanceExtra[code]);
+}
+
+static uint32_t Hash(const uint8_t* data) {
+	uint32_t key = ((uint32_t)data[0] << 16) | ((uint32_t)data[1] << 8) | data[2];
+	return (key * 2654435761u) >> (32 - HASH_BITS);
+}
+
+static void InsertPosition(ImageWriter* image, int index) {
+	uint32_t hash = Hash(image->window + index);
+	int64_t position = image->windowStart + index;
+	image->chain[position & (WINDOW_SIZE - 1)] = image->head[hash];
+	image->head[hash] = position;
+}
+
+//greedy matching of window[begin, end), matches never reach past end
+static void CompressWindow(ImageWriter* image, int begin, int end) {
+	const uint8_t* window = image->window;
+	int index = begin;
+
+	while (index < end) {
+		int bestLength = 0, bestDistance = 0;
+		if (index + MIN_MATCH <= end) {
+			int maxLength = end - index < MAX_MATCH ? end - index : MAX_MATCH;
+			int64_t position = image->windowStart + index;
+			int64_t candidate = image->head[Hash(window + index)];
+
+			for (int tries = 0; tries < MAX_CHAIN && candidate >= image->windowStart && position - candidate <= WINDOW_SIZE; tries++) {
+				const uint8_t* a = window + (candidate - image->windowStart);
+				const uint8_t* b = window + index;
+				int length = 0;
+				while (length < maxLength && a[length] == b[length]) {
+					length++;
+				}
+				if (length > bestLength) {
+					bestLength = length;
+					bestDistance = (int)(position - candidate);
+					if (length == maxLength)
+						break;
+				}
+				candidate = image->chain[candidate & (WINDOW_SIZE - 1)];
+			}
+		}
+
+		if (bestLength >= MIN_MATCH) {
+			PutMatch(image, bestLength, bestDistance);
+			for (int i = 0; i < bestLength; i++, index++) {
+				if (index + MIN_MATCH <= end)
+					InsertPosition(image, index);
+			}
+		}
+		else {
+			PutSymbol(image, window[index]);
+			if (index + MIN_MATCH <= end)
+				InsertPosition(image, index);
+			index++;
+		}
+	}
+}
+
+static void Deflate(ImageWriter* image, const uint8_t* data, int size) {
+	image->adler = UpdateAdler(image->adler, data, size);
+
+	while (size > 0) {
+		int n = size < WINDOW_SIZE ? size : WINDOW_SIZE;
+		//keep the last WINDOW_SIZE bytes as match history
+		if (image->windowFill + n > 2 * WINDOW_SIZE) {
+			int drop = image->windowFill - WINDOW_SIZE;
+			memmove(image->window, image->window + drop, WINDOW_SIZE);
+			image->windowStart += drop;
+			image->windowFill = WINDOW_SIZE;
+		}
+
+		int begin = image->windowFill;
+		memcpy(image->window + begin, data, n);
+		image->windowFill += n;
+		CompressWindow(image, begin, image->windowFill);
+
+		data += n;
+		size -= n;
+	}
+}
+
+
+static int Paeth(int a, int b, int c) {
+	int p = a + b - c;
+	int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+	if (pa <= pb && pa <= pc)
+		return a;
+	return pb <= pc ? b : c;
+}
+
+static void FilterRow(ImageWriter* image, const uint8_t* row) {
+	const int size = image->width * image->pixelSize;
+	const int left = image->pixelSize;		//the filters predict from the same byte of the pixel to the left
+	const uint8_t* up = image->previous;
+	long long bestScore = -1;
+
+	for (int type = 0; type <= 4; type++) {
+		uint8_t* out = image->trial;
+		long long score = 0;
+		out[0] = (uint8_t)type;
+		for (int i = 0; i < size; i++) {
+			int a = i >= left ? row[i - left] : 0;
+			int b = up[i];
+			int c = i >= left ? up[i - left] : 0;
+			int predictor = 0;
+			switch (type) {
+			case 1: predictor = a; break;
+			case 2: predictor = b; break;
+			case 3: predictor = (a + b) / 2; break;
+			case 4: predictor = Paeth(a, b, c); break;
+			}
+			uint8_t residual = (uint8_t)(row[i] - predictor);
+			out[1 + i] = residual;
+			score += residual < 128 ? residual : 256 - residual;
+		}
+
+		if (bestScore < 0 || score < bestScore) {
+			bestScore = score;
+			uint8_t* swap = image->filtered;
+			image->filtered = image->trial;
+			image->trial = swap;
+		}
+	}
+
+	memcpy(image->previous, row, size);
+}
+
+
+ImageWriter* ImageOpen(const char* path, int width, int height) {
+	return ImageOpenDepth(path, width, height, 8);
+}
+
+ImageWriter* ImageOpenDepth(const char* path, int width, int height, int depth) {
+	FILE* file = fopen(path, "wb");
+	if (!file)
+		return NULL;
+
+	ImageWriter* image = (ImageWriter*)calloc(1, sizeof(ImageWriter));
+	image->file = file;
+	image->width = width;
+	image->height = height;
+	image->pixelSize = depth == 16 ? 6 : 3;
+
+	const char* extension = strrchr(path, '.');
+	image->png = !(extension && (strcmp(extension, ".ppm") == 0 || strcmp(extension, ".PPM") == 0));
+
+	if (!image->png) {
+		fprintf(file, "P6\n%d %d\n%d\n", width, height, depth == 16 ? 65535 : 255);
+		return image;
+	}
+
+	for (uint32_t i = 0; i < 256; i++) {
+		uint32_t crc = i;
+		for (int k = 0; k < 8; k++) {
+			crc = crc & 1 ? 0xedb88320u ^ (crc >> 1) : crc >> 1;
+		}
+		image->crcTable[i] = crc;
+	}
+	for (int i = 0; i < HASH_SIZE; i++) {
+		image->head[i] = -1;
+	}
+	image->adler = 1;
+	image->previous = (uint8_t*)calloc(width * image->pixelSize, 1);
+	image->filtered = (uint8_t*)malloc(width * image->pixelSize + 1);
+	image->trial = (uint8_t*)malloc(width * image->pixelSize + 1);
+
+	static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+	WriteBytes(image, signature, 8);
+
+	//8 or 16 bit rgb, no interlacing
+	uint8_t header[13] = {
+		(uint8_t)(width >> 24), (uint8_t)(width >> 16), (uint8_t)(width >> 8), (uint8_t)width,
+		(uint8_t)(height >> 24), (uint8_t)(height >> 16), (uint8_t)(height >> 8), (uint8_t)height,
+		(uint8_t)(depth == 16 ? 16 : 8), 2, 0, 0, 0
+	};
+	WriteChunk(image, "IHDR", header, 13);
+
+	//zlib header for a 32 KiB window, then the start of the final fixed Huffman block
+	PutByte(image, 0x78);
+	PutByte(image, 0x01);
+	PutBits(image, 1, 1);
+	PutBits(image, 1, 2);
+	return image;
+}
+
+int ImageWriteRows(ImageWriter* image, const uint8_t* rgb, int rows) {
+	const int size = image->width * image->pixelSize;
+	for (int y = 0; y < rows && !image->failed; y++) {
+		if (image->png) {
+			FilterRow(image, rgb + (size_t)y * size);
+			Deflate(image, image->filtered, size + 1);
+		}
+		else {
+			WriteBytes(image, rgb + (size_t)y * size, size);
+		}
+	}
+	image->rowsWritten += rows;
+	return !image->failed;
+}
+
+int ImageClose(ImageWriter* image) {
+	if (image->png) {
+		PutSymbol(image, 256);		//end of block
+		if (image->bitCount > 0)
+			PutBits(image, 0, 8 - image->bitCount);
+		PutByte(image, (uint8_t)(image->adler >> 24));
+		PutByte(image, (uint8_t)(image->adler >> 16));
+		PutByte(image, (uint8_t)(image->adler >> 8));
+		PutByte(image, (uint8_t)image->adler);
+		FlushChunk(image);
+		WriteChunk(image, "IEND", NULL, 0);
+	}
+
+	int ok = !image->failed && image->rowsWritten == image->height;
+	if (fclose(image->file) != 0)
+		ok = 0;
+	free(image->previous);
+	free(image->filtered);
+	free(image->trial);
+	free(image);
+	return ok;
+}
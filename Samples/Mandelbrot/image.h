@@ -0,0 +1,24 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+/*
+	Streaming image writer for posters
+
+	Rows are handed over top to bottom as 8 bit rgb and written out immediately, so the
+	memory use does not depend on the image size. The format follows the file extension:
+	.ppm writes binary P6, anything else a PNG compressed with a small built in deflate
+	encoder (fixed Huffman codes, hash chain matching over the 32 KiB deflate window).
+	Images opened with a depth of 16 take rows of 16 bit big endian samples, as both
+	formats store them.
+*/
+
+#include <stdint.h>
+
+typedef struct ImageWriter ImageWriter;
+
+ImageWriter* ImageOpen(const char* path, int width, int height);		//NULL when the file cannot be created
+ImageWriter* ImageOpenDepth(const char* path, int width, int height, int depth);	//depth 8 or 16 bits per sample
+int ImageWriteRows(ImageWriter* image, const uint8_t* rgb, int rows);	//returns 0 on write errors
+int ImageClose(ImageWriter* image);		//finishes the file, returns 0 when anything failed
+
+#endif
@@ -0,0 +1,432 @@
+#include "mandelbrot.h"
+
+/*
+	Escape-time kernels with runtime instruction set dispatch
+
+	The vector kernels are compiled for their instruction set with function level target
+	attributes on gcc/clang (msvc allows intrinsics without flags), so the rest of the
+	program still runs on any x86 cpu and BestKernel picks what the cpu supports.
+*/
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define HAS_X86_KERNELS 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define TARGET_SSE2
+#define TARGET_AVX2
+#define TARGET_AVX512
+#else
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#define TARGET_AVX512 __attribute__((target("avx512f")))
+#endif
+#else
+#define HAS_X86_KERNELS 0
+#endif
+
+//every instruction set has to give the same counts as the scalar reference, gcc would
+//otherwise fuse multiplies and adds into fma wherever the target has it (avx512f does)
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC optimize("fp-contract=off")
+#endif
+
+
+/*
+	Kernels are generated per instruction set and exponent n from the macros below, z^n + c
+	is computed with n as a compile time constant. COMPLEX_POWER squares and multiplies over
+	the bits of n, the loop and branches fold away and z^2 comes out as the same three
+	multiplications as a hand written quadratic loop (the squares are shared with the escape
+	test). Julia sets only differ in the start values and use the same kernels.
+*/
+#define EXPONENT_TOP_BIT(n) ((n) >= 8 ? 3 : (n) >= 4 ? 2 : (n) >= 2 ? 1 : 0)
+
+//declares w = z^n of type T from the multiply, add and subtract operations of an instruction set
+#define COMPLEX_POWER(T, MUL, ADD, SUB, n, zr, zi, wr, wi)							\
+	T wr = zr, wi = zi;																	\
+	for (int bit = EXPONENT_TOP_BIT(n) - 1; bit >= 0; bit--) {							\
+		T sr = SUB(MUL(wr, wr), MUL(wi, wi));											\
+		T si = MUL(wr, wi);																\
+		wr = sr;																		\
+		wi = ADD(si, si);																\
+		if (((n) >> bit) & 1) {															\
+			T mr = SUB(MUL(wr, zr), MUL(wi, zi));										\
+			wi = ADD(MUL(wr, zi), MUL(wi, zr));											\
+			wr = mr;																	\
+		}																				\
+	}
+
+//instantiates a kernel macro for every exponent up to MAX_EXPONENT
+#define FOR_EACH_EXPONENT(KERNEL) KERNEL(2) KERNEL(3) KERNEL(4) KERNEL(5) KERNEL(6) KERNEL(7) KERNEL(8)
+#define KERNEL_TABLE(name) { NULL, NULL, name##2, name##3, name##4, name##5, name##6, name##7, name##8 }
+
+
+#define SCALAR_MUL(a, b) ((a) * (b))
+#define SCALAR_ADD(a, b) ((a) + (b))
+#define SCALAR_SUB(a, b) ((a) - (b))
+
+//the reference kernels, escape test through absolute like doesDiverge
+#define SCALAR_KERNEL(n)																\
+static int EscapeScalar##n(const float* cReal, const float* cImag, float* zReal, float* zImag, int* iterations, int count, int maxIterations, float radius, bool periodicity) { \
+	int periodic = 0;																	\
+																						\
+	for (int i = 0; i < count; i++) {													\
+		Complex c = initComplex(cReal[i], cImag[i]);									\
+		Complex z = initComplex(zReal[i], zImag[i]);									\
+		int iter = iterations[i];														\
+																						\
+		Complex check = z;																\
+		int step = 0, nextCheck = 1;													\
+																						\
+		while (absolute(z) <= radius && iter < maxIterations) {							\
+			COMPLEX_POWER(float, SCALAR_MUL, SCALAR_ADD, SCALAR_SUB, n, z.real, z.imag, wr, wi); \
+			z = add(initComplex(wr, wi), c);											\
+			iter += 1;																	\
+			if (!periodicity)															\
+				continue;																\
+																						\
+			step += 1;																	\
+			float dr = z.real - check.real, di = z.imag - check.imag;					\
+			if (dr * dr + di * di < PERIODICITY_EPSILON && iter < maxIterations) {		\
+				iter = maxIterations + 1;												\
+				periodic += 1;															\
+				break;																	\
+			}																			\
+			if (step == nextCheck) {													\
+				check = z;																\
+				nextCheck *= 2;															\
+			}																			\
+		}																				\
+																						\
+		zReal[i] = z.real;																\
+		zImag[i] = z.imag;																\
+		iterations[i] = iter;															\
+	}																					\
+																						\
+	return periodic;																	\
+}
+
+FOR_EACH_EXPONENT(SCALAR_KERNEL)
+static const EscapeKernel scalarKernels[MAX_EXPONENT + 1] = KERNEL_TABLE(EscapeScalar);
+
+
+#if HAS_X86_KERNELS
+
+/*
+	Every vector kernel copies count pixels into lane sized blocks, lanes past the end are
+	started at maxIterations so they are inactive from the first step. A lane stays active
+	while |z|^2 <= radius^2 and iter < maxIterations, inactive lanes keep their z and count.
+	The periodicity checkpoint is moved for all lanes of a block at once, only lanes that
+	were iterated in the current step and are still below maxIterations can be caught.
+*/
+#define LOAD_BLOCK(lanes)																\
+	float cr[lanes], ci[lanes], zr[lanes], zi[lanes];									\
+	int it[lanes];																		\
+	int n = count - i < lanes ? count - i : lanes;										\
+	for (int k = 0; k < lanes; k++) {													\
+		cr[k] = k < n ? cReal[i + k] : 0.0f;											\
+		ci[k] = k < n ? cImag[i + k] : 0.0f;											\
+		zr[k] = k < n ? zReal[i + k] : 0.0f;											\
+		zi[k] = k < n ? zImag[i + k] : 0.0f;											\
+		it[k] = k < n ? iterations[i + k] : maxIterations;								\
+	}
+
+#define STORE_BLOCK()																	\
+	for (int k = 0; k < n; k++) {														\
+		zReal[i + k] = zr[k];															\
+		zImag[i + k] = zi[k];															\
+		iterations[i + k] = it[k];														\
+	}
+
+static int CountBits(unsigned mask) {
+	int count = 0;
+	for (; mask; mask &= mask - 1) {
+		count += 1;
+	}
+	return count;
+}
+
+
+#define SSE2_KERNEL(exponent)															\
+TARGET_SSE2 static int EscapeSSE2_##exponent(const float* cReal, const float* cImag, float* zReal, float* zImag, int* iterations, int count, int maxIterations, float radius, bool periodicity) { \
+	const __m128 radius2 = _mm_set1_ps(radius * radius);								\
+	const __m128 epsilon = _mm_set1_ps(PERIODICITY_EPSILON);							\
+	const __m128i limit = _mm_set1_epi32(maxIterations);								\
+	const __m128i cycleMark = _mm_set1_epi32(maxIterations + 1);						\
+	int periodic = 0;																	\
+																						\
+	for (int i = 0; i < count; i += 4) {												\
+		LOAD_BLOCK(4);																	\
+																						\
+		__m128 c_re = _mm_loadu_ps(cr), c_im = _mm_loadu_ps(ci);						\
+		__m128 z_re = _mm_loadu_ps(zr), z_im = _mm_loadu_ps(zi);						\
+		__m128i iter = _mm_loadu_si128((const __m128i*)it);								\
+		__m128 check_re = z_re, check_im = z_im;										\
+		int step = 0, nextCheck = 1;													\
+																						\
+		for (;;) {																		\
+			__m128 re2 = _mm_mul_ps(z_re, z_re);										\
+			__m128 im2 = _mm_mul_ps(z_im, z_im);										\
+			__m128 inside = _mm_cmple_ps(_mm_add_ps(re2, im2), radius2);				\
+			__m128 active = _mm_and_ps(inside, _mm_castsi128_ps(_mm_cmplt_epi32(iter, limit))); \
+			if (_mm_movemask_ps(active) == 0)											\
+				break;																	\
+																						\
+			COMPLEX_POWER(__m128, _mm_mul_ps, _mm_add_ps, _mm_sub_ps, exponent, z_re, z_im, w_re, w_im); \
+			__m128 re = _mm_add_ps(w_re, c_re);											\
+			__m128 im = _mm_add_ps(w_im, c_im);											\
+																						\
+			z_re = _mm_or_ps(_mm_and_ps(active, re), _mm_andnot_ps(active, z_re));		\
+			z_im = _mm_or_ps(_mm_and_ps(active, im), _mm_andnot_ps(active, z_im));		\
+			iter = _mm_sub_epi32(iter, _mm_castps_si128(active));	/*active lanes are -1*/	\
+			if (!periodicity)															\
+				continue;																\
+																						\
+			step += 1;																	\
+			__m128 dr = _mm_sub_ps(z_re, check_re), di = _mm_sub_ps(z_im, check_im);	\
+			__m128 close = _mm_cmplt_ps(_mm_add_ps(_mm_mul_ps(dr, dr), _mm_mul_ps(di, di)), epsilon); \
+			__m128 cycle = _mm_and_ps(_mm_and_ps(active, close), _mm_castsi128_ps(_mm_cmplt_epi32(iter, limit))); \
+			int cycleMask = _mm_movemask_ps(cycle);										\
+			if (cycleMask) {															\
+				__m128i finished = _mm_castps_si128(cycle);								\
+				iter = _mm_or_si128(_mm_and_si128(finished, cycleMark), _mm_andnot_si128(finished, iter)); \
+				periodic += CountBits(cycleMask);										\
+			}																			\
+			if (step == nextCheck) {													\
+				check_re = z_re;														\
+				check_im = z_im;														\
+				nextCheck *= 2;															\
+			}																			\
+		}																				\
+																						\
+		_mm_storeu_ps(zr, z_re);														\
+		_mm_storeu_ps(zi, z_im);														\
+		_mm_storeu_si128((__m128i*)it, iter);											\
+		STORE_BLOCK();																	\
+	}																					\
+																						\
+	return periodic;																	\
+}
+
+FOR_EACH_EXPONENT(SSE2_KERNEL)
+static const EscapeKernel sse2Kernels[MAX_EXPONENT + 1] = KERNEL_TABLE(EscapeSSE2_);
+
+
+#define AVX2_KERNEL(exponent)															\
+TARGET_AVX2 static int EscapeAVX2_##exponent(const float* cReal, const float* cImag, float* zReal, float* zImag, int* iterations, int count, int maxIterations, float radius, bool periodicity) { \
+	const __m256 radius2 = _mm256_set1_ps(radius * radius);								\
+	const __m256 epsilon = _mm256_set1_ps(PERIODICITY_EPSILON);							\
+	const __m256i limit = _mm256_set1_epi32(maxIterations);								\
+	const __m256i cycleMark = _mm256_set1_epi32(maxIterations + 1);						\
+	int periodic = 0;																	\
+																						\
+	for (int i = 0; i < count; i += 8) {												\
+		LOAD_BLOCK(8);																	\
+																						\
+		__m256 c_re = _mm256_loadu_ps(cr), c_im = _mm256_loadu_ps(ci);					\
+		__m256 z_re = _mm256_loadu_ps(zr), z_im = _mm256_loadu_ps(zi);					\
+		__m256i iter = _mm256_loadu_si256((const __m256i*)it);							\
+		__m256 check_re = z_re, check_im = z_im;										\
+		int step = 0, nextCheck = 1;													\
+																						\
+		for (;;) {																		\
+			__m256 re2 = _mm256_mul_ps(z_re, z_re);										\
+			__m256 im2 = _mm256_mul_ps(z_im, z_im);										\
+			__m256 inside = _mm256_cmp_ps(_mm256_add_ps(re2, im2), radius2, _CMP_LE_OQ);	\
+			__m256 active = _mm256_and_ps(inside, _mm256_castsi256_ps(_mm256_cmpgt_epi32(limit, iter))); \
+			if (_mm256_movemask_ps(active) == 0)										\
+				break;																	\
+																						\
+			COMPLEX_POWER(__m256, _mm256_mul_ps, _mm256_add_ps, _mm256_sub_ps, exponent, z_re, z_im, w_re, w_im); \
+			__m256 re = _mm256_add_ps(w_re, c_re);										\
+			__m256 im = _mm256_add_ps(w_im, c_im);										\
+																						\
+			z_re = _mm256_blendv_ps(z_re, re, active);									\
+			z_im = _mm256_blendv_ps(z_im, im, active);									\
+			iter = _mm256_sub_epi32(iter, _mm256_castps_si256(active));					\
+			if (!periodicity)															\
+				continue;																\
+																						\
+			step += 1;																	\
+			__m256 dr = _mm256_sub_ps(z_re, check_re), di = _mm256_sub_ps(z_im, check_im);	\
+			__m256 close = _mm256_cmp_ps(_mm256_add_ps(_mm256_mul_ps(dr, dr), _mm256_mul_ps(di, di)), epsilon, _CMP_LT_OQ); \
+			__m256 cycle = _mm256_and_ps(_mm256_and_ps(active, close), _mm256_castsi256_ps(_mm256_cmpgt_epi32(limit, iter))); \
+			int cycleMask = _mm256_movemask_ps(cycle);									\
+			if (cycleMask) {															\
+				iter = _mm256_blendv_epi8(iter, cycleMark, _mm256_castps_si256(cycle));	\
+				periodic += CountBits(cycleMask);										\
+			}																			\
+			if (step == nextCheck) {													\
+				check_re = z_re;														\
+				check_im = z_im;														\
+				nextCheck *= 2;															\
+			}																			\
+		}																				\
+																						\
+		_mm256_storeu_ps(zr, z_re);														\
+		_mm256_storeu_ps(zi, z_im);														\
+		_mm256_storeu_si256((__m256i*)it, iter);										\
+		STORE_BLOCK();																	\
+	}																					\
+																						\
+	return periodic;																	\
+}
+
+FOR_EACH_EXPONENT(AVX2_KERNEL)
+static const EscapeKernel avx2Kernels[MAX_EXPONENT + 1] = KERNEL_TABLE(EscapeAVX2_);
+
+
+#define AVX512_KERNEL(exponent)															\
+TARGET_AVX512 static int EscapeAVX512_##exponent(const float* cReal, const float* cImag, float* zReal, float* zImag, int* iterations, int count, int maxIterations, float radius, bool periodicity) { \
+	const __m512 radius2 = _mm512_set1_ps(radius * radius);								\
+	const __m512 epsilon = _mm512_set1_ps(PERIODICITY_EPSILON);							\
+	const __m512i limit = _mm512_set1_epi32(maxIterations);								\
+	const __m512i cycleMark = _mm512_set1_epi32(maxIterations + 1);						\
+	const __m512i one = _mm512_set1_epi32(1);											\
+	int periodic = 0;																	\
+																						\
+	for (int i = 0; i < count; i += 16) {												\
+		LOAD_BLOCK(16);																	\
+																						\
+		__m512 c_re = _mm512_loadu_ps(cr), c_im = _mm512_loadu_ps(ci);					\
+		__m512 z_re = _mm512_loadu_ps(zr), z_im = _mm512_loadu_ps(zi);					\
+		__m512i iter = _mm512_loadu_si512(it);											\
+		__m512 check_re = z_re, check_im = z_im;										\
+		int step = 0, nextCheck = 1;													\
+																						\
+		for (;;) {																		\
+			__m512 re2 = _mm512_mul_ps(z_re, z_re);										\
+			__m512 im2 = _mm512_mul_ps(z_im, z_im);										\
+			__mmask16 active = _mm512_cmp_ps_mask(_mm512_add_ps(re2, im2), radius2, _CMP_LE_OQ); \
+			active = _mm512_mask_cmplt_epi32_mask(active, iter, limit);					\
+			if (active == 0)															\
+				break;																	\
+																						\
+			COMPLEX_POWER(__m512, _mm512_mul_ps, _mm512_add_ps, _mm512_sub_ps, exponent, z_re, z_im, w_re, w_im); \
+			z_re = _mm512_mask_add_ps(z_re, active, w_re, c_re);						\
+			z_im = _mm512_mask_add_ps(z_im, active, w_im, c_im);						\
+			iter = _mm512_mask_add_epi32(iter, active, iter, one);						\
+			if (!periodicity)															\
+				continue;																\
+																						\
+			step += 1;																	\
+			__m512 dr = _mm512_sub_ps(z_re, check_re), di = _mm512_sub_ps(z_im, check_im);	\
+			__mmask16 cycle = _mm512_mask_cmp_ps_mask(active, _mm512_add_ps(_mm512_mul_ps(dr, dr), _mm512_mul_ps(di, di)), epsilon, _CMP_LT_OQ); \
+			cycle = _mm512_mask_cmplt_epi32_mask(cycle, iter, limit);					\
+			if (cycle) {																\
+				iter = _mm512_mask_mov_epi32(iter, cycle, cycleMark);					\
+				periodic += CountBits(cycle);											\
+			}																			\
+			if (step == nextCheck) {													\
+				check_re = z_re;														\
+				check_im = z_im;														\
+				nextCheck *= 2;															\
+			}																			\
+		}																				\
+																						\
+		_mm512_storeu_ps(zr, z_re);														\
+		_mm512_storeu_ps(zi, z_im);														\
+		_mm512_storeu_si512(it, iter);													\
+		STORE_BLOCK();																	\
+	}																					\
+																						\
+	return periodic;																	\
+}
+
+FOR_EACH_EXPONENT(AVX512_KERNEL)
+static const EscapeKernel avx512Kernels[MAX_EXPONENT + 1] = KERNEL_TABLE(EscapeAVX512_);
+
+
+typedef struct CpuFeatures {
+	bool detected;
+	bool sse2, avx2, avx512;
+}CpuFeatures;
+
+static CpuFeatures DetectCpu(void) {
+	CpuFeatures cpu = { 0 };
+	cpu.detected = true;
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 0);
+	int maxLeaf = info[0];
+
+	__cpuid(info, 1);
+	cpu.sse2 = (info[3] & (1 << 26)) != 0;
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool avx = (info[2] & (1 << 28)) != 0;
+
+	//the os has to save the wide registers on context switches as well
+	unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+	if (maxLeaf >= 7) {
+		__cpuidex(info, 7, 0);
+		cpu.avx2 = avx && (info[1] & (1 << 5)) && (xcr0 & 0x6) == 0x6;
+		cpu.avx512 = (info[1] & (1 << 16)) && (xcr0 & 0xe6) == 0xe6;
+	}
+#else
+	//libgcc and compiler-rt check the os support (xgetbv) for us
+	__builtin_cpu_init();
+	cpu.sse2 = __builtin_cpu_supports("sse2") != 0;
+	cpu.avx2 = __builtin_cpu_supports("avx2") != 0;
+	cpu.avx512 = __builtin_cpu_supports("avx512f") != 0;
+#endif
+	return cpu;
+}
+
+#endif
+
+
+const char* KernelName(KernelType type) {
+	switch (type) {
+	case KERNEL_SCALAR: return "scalar";
+	case KERNEL_SSE2: return "sse2";
+	case KERNEL_AVX2: return "avx2";
+	case KERNEL_AVX512: return "avx512";
+	default: return "unknown";
+	}
+}
+
+bool KernelSupported(KernelType type) {
+	if (type == KERNEL_SCALAR)
+		return true;
+#if HAS_X86_KERNELS
+	static CpuFeatures cpu;
+	if (!cpu.detected)
+		cpu = DetectCpu();
+
+	switch (type) {
+	case KERNEL_SSE2: return cpu.sse2;
+	case KERNEL_AVX2: return cpu.avx2;
+	case KERNEL_AVX512: return cpu.avx512;
+	default: return false;
+	}
+#else
+	return false;
+#endif
+}
+
+EscapeKernel GetPowerKernel(KernelType type, int exponent) {
+	if (!KernelSupported(type) || exponent < 2 || exponent > MAX_EXPONENT)
+		return NULL;
+
+	switch (type) {
+	case KERNEL_SCALAR: return scalarKernels[exponent];
+#if HAS_X86_KERNELS
+	case KERNEL_SSE2: return sse2Kernels[exponent];
+	case KERNEL_AVX2: return avx2Kernels[exponent];
+	case KERNEL_AVX512: return avx512Kernels[exponent];
+#endif
+	default: return NULL;
+	}
+}
+
+EscapeKernel GetKernel(KernelType type) {
+	return GetPowerKernel(type, 2);
+}
+
+KernelType BestKernel(void) {
+	for (int type = KERNEL_COUNT - 1; type > KERNEL_SCALAR; type--) {
+		if (KernelSupported((KernelType)type))
+			return (KernelType)type;
+	}
+	return KERNEL_SCALAR;
+}
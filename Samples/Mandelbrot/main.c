@@ -18,17 +18,15 @@ https://youtu.be/FFftmWSzgmk
 //TODO: build for linux
 //TODO: Fix gcc build
 
+#include "mandelbrot.h"
+
 #include <stdio.h>
+#include <string.h>
 #include <math.h>
 #include "glfw/include/GLFW/glfw3.h"
 #include <stdlib.h>
 
 
-//change the maximum amount of iteration here, more the iteration higher the quality but slower
-#define maxIter 100
-
-#define minimum(a, b)			(((a) < (b)) ? (a) : (b))
-
 /*
 	To change the colors, change the values here
 */
@@ -38,20 +36,6 @@ float blueWeight = 3.0f;
 
 
 
-typedef enum bool{
-	false,true
-}bool;
-
-
-//complex number
-typedef struct Complex {
-	float real;
-	float imag;
-}Complex;
-
-Complex start, end;
-
-
 //slider for color weights
 typedef enum Color {
 	red = 0, green = 1, blue = 2
@@ -66,98 +50,168 @@ typedef struct Slider {
 }Slider;
 
 
-//screen parameters
-typedef struct Screen {
-	float* colors;
-	int width, height;
-}Screen;
-
-
-Complex initComplex(float real, float imag) {
-	Complex c;
-	c.real = real;
-	c.imag = imag;
-
-	return c;
+/*
+	Display
+
+	The colored frame lives in an RGBA8 texture that is drawn as one quad. It is only
+	uploaded again when the render thread published a new frame or the color weights
+	change; the weights only rebuild the palette and never touch the shades. Uploads go
+	through a ring of pixel buffer objects: the frame is colored straight into a mapped
+	buffer and glTexSubImage2D copies from it asynchronously, while the next upload already
+	writes to the next buffer. Without buffer objects (GL older than 2.1) the texture is
+	updated from client memory instead. The texture and the client copy only grow, so a
+	window resize rarely reallocates them. Equalized frames come with the distribution of
+	their shades, which is folded into a second palette before the frame is colored.
+*/
+#ifndef GL_CLAMP_TO_EDGE
+#define GL_CLAMP_TO_EDGE 0x812F
+#endif
+#ifndef GL_PIXEL_UNPACK_BUFFER
+#define GL_PIXEL_UNPACK_BUFFER 0x88EC
+#endif
+#ifndef GL_STREAM_DRAW
+#define GL_STREAM_DRAW 0x88E0
+#endif
+#ifndef GL_WRITE_ONLY
+#define GL_WRITE_ONLY 0x88B9
+#endif
+
+//the windows gl header stops at 1.1, buffer objects are loaded at runtime everywhere
+typedef void (GLAPIENTRY *GenBuffersProc)(GLsizei n, GLuint* buffers);
+typedef void (GLAPIENTRY *DeleteBuffersProc)(GLsizei n, const GLuint* buffers);
+typedef void (GLAPIENTRY *BindBufferProc)(GLenum target, GLuint buffer);
+typedef void (GLAPIENTRY *BufferDataProc)(GLenum target, ptrdiff_t size, const void* data, GLenum usage);
+typedef void* (GLAPIENTRY *MapBufferProc)(GLenum target, GLenum access);
+typedef GLboolean (GLAPIENTRY *UnmapBufferProc)(GLenum target);
+
+static GenBuffersProc genBuffers;
+static DeleteBuffersProc deleteBuffers;
+static BindBufferProc bindBuffer;
+static BufferDataProc bufferData;
+static MapBufferProc mapBuffer;
+static UnmapBufferProc unmapBuffer;
+
+#define UPLOAD_BUFFERS 3
+
+typedef struct Display {
+	GLuint texture;
+	int width, height;			//frame size
+	int textureWidth, textureHeight;	//allocated, grows geometrically and the frame fills its lower left corner
+	bool streaming;				//pixel buffer objects are available
+	GLuint buffers[UPLOAD_BUFFERS];
+	int nextBuffer;
+	uint8_t* pixels;			//client side copy when not streaming
+
+	//what the texture shows
+	bool valid;
+	unsigned revision;
+	Palette palette;
+	Palette equalized;			//palette spread over the distribution of the frame
+}Display;
+
+void initDisplay(Display* display) {
+	genBuffers = (GenBuffersProc)glfwGetProcAddress("glGenBuffers");
+	deleteBuffers = (DeleteBuffersProc)glfwGetProcAddress("glDeleteBuffers");
+	bindBuffer = (BindBufferProc)glfwGetProcAddress("glBindBuffer");
+	bufferData = (BufferDataProc)glfwGetProcAddress("glBufferData");
+	mapBuffer = (MapBufferProc)glfwGetProcAddress("glMapBuffer");
+	unmapBuffer = (UnmapBufferProc)glfwGetProcAddress("glUnmapBuffer");
+	display->streaming = genBuffers && deleteBuffers && bindBuffer && bufferData && mapBuffer && unmapBuffer;
+
+	glGenTextures(1, &display->texture);
+	glBindTexture(GL_TEXTURE_2D, display->texture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	if (display->streaming)
+		genBuffers(UPLOAD_BUFFERS, display->buffers);
 }
 
-
-Complex add(Complex c1, Complex c2) {
-	Complex result;
-	result.real = c1.real + c2.real;
-	result.imag = c1.imag + c2.imag;
-
-	return result;
+void destroyDisplay(Display* display) {
+	if (display->streaming)
+		deleteBuffers(UPLOAD_BUFFERS, display->buffers);
+	glDeleteTextures(1, &display->texture);
+	free(display->pixels);
+	PaletteFree(&display->palette);
+	PaletteFree(&display->equalized);
 }
 
-Complex multiply(Complex c1, Complex c2) {
-	Complex result;
-	result.real = c1.real * c2.real - c1.imag * c2.imag;
-	result.imag = c1.real * c2.imag + c1.imag * c2.real;
-
-	return result;
-}
 
-float absolute(Complex c) {
-	double real = (double)c.real;
-	double imag = (double)c.imag;
-	float magnitude = sqrt(real * real + imag * imag);
-	return magnitude;
+//on this thread, the worker pool may be busy with the render thread for a while
+static void colorize(const Palette* palette, const Shade* colors, const EdgeSamples* samples, int width, int height, uint8_t* pixels) {
+	ColorizePixels(colors, width * height, palette, pixels, 4);
+	ColorizeSamples(samples, palette, pixels, 4);
 }
 
+static void uploadDisplay(Display* display, const Shade* colors, const EdgeSamples* samples, int width, int height, const Palette* palette) {
+	const ptrdiff_t size = (ptrdiff_t)width * height * 4;
 
-int doesDiverge(Complex* c, float radius) {
-	Complex z = initComplex(0.0f, 0.0f);
-	int iter = 0;
-
-	while (absolute(z) <= radius && iter < maxIter) {
-		z = add(multiply(z, z), *c);
-		iter += 1;
+	glBindTexture(GL_TEXTURE_2D, display->texture);
+	if (width > display->textureWidth || height > display->textureHeight) {
+		display->textureWidth = width > display->textureWidth * 3 / 2 ? width : display->textureWidth * 3 / 2;
+		display->textureHeight = height > display->textureHeight * 3 / 2 ? height : display->textureHeight * 3 / 2;
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, display->textureWidth, display->textureHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+		if (!display->streaming)
+			display->pixels = (uint8_t*)realloc(display->pixels, (size_t)display->textureWidth * display->textureHeight * 4);
 	}
-
-	//for returning complex number
-	*c = z;
-
-	return iter;
-}
-
-
-void MandelbrotSet(int width, int height, float* colors) {
-	const float radius = 4.0f;
-
-	for (int y = 0; y < height; y++) {
-		float imag = start.imag + ((float)y / height) * (end.imag - start.imag);
-		for (int x = 0; x < width; x++) {
-			float real = start.real + ((float)x / width) * (end.real - start.real);
-
-			Complex z = initComplex(real, imag);
-
-			int nIter = doesDiverge(&z, radius);
-
-			colors[x + y * width] = (float)((nIter - log2(absolute(z) / radius)) / maxIter) * 255;
+	display->width = width;
+	display->height = height;
+
+	if (display->streaming) {
+		bindBuffer(GL_PIXEL_UNPACK_BUFFER, display->buffers[display->nextBuffer]);
+		//fresh storage every time, so the driver never waits for a copy still reading the old one
+		bufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+		uint8_t* pixels = (uint8_t*)mapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
+		if (pixels) {
+			colorize(palette, colors, samples, width, height, pixels);
+			unmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
 		}
+		bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		display->nextBuffer = (display->nextBuffer + 1) % UPLOAD_BUFFERS;
+	}
+	else {
+		colorize(palette, colors, samples, width, height, display->pixels);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, display->pixels);
 	}
 }
 
+void rendermandelbrot(Display* display, Renderer* renderer) {
+	int width, height;
+	unsigned revision;
+	const float weights[3] = { redWeight, greenWeight, blueWeight };
+	bool recolored = PaletteUpdate(&display->palette, weights);
+
+	const Shade* colors = RendererLockFrame(renderer, &width, &height, &revision);
+	if (colors && (recolored || !display->valid || display->revision != revision)) {
+		const uint32_t* cumulative = RendererFrameHistogram(renderer);
+		if (cumulative)
+			PaletteEqualize(&display->equalized, weights, cumulative);
+		const Palette* palette = cumulative ? &display->equalized : &display->palette;
+		uploadDisplay(display, colors, RendererFrameSamples(renderer), width, height, palette);
+		display->valid = true;
+		display->revision = revision;
+	}
+	RendererUnlockFrame(renderer);
+	if (!display->valid)
+		return;
 
-void rendermandelbrot(float* colors, int width, int height) {
+	//the first texture row is the bottom row of the frame, a frame of another size (a resize
+	//preview or the frame before it) is stretched over the window
+	float u = (float)display->width / display->textureWidth, v = (float)display->height / display->textureHeight;
 	glLoadIdentity();
-	glOrtho(0, width, 0, height, -1, 1);
-	glBegin(GL_POINTS);
-
-	for (int y = 0; y < height; y++) {
-		for (int x = 0; x < width; x++) {
-			const float color = colors[x + y * width];
-
-			const float r = minimum(255.0f, redWeight * color) / 255;
-			const float g = minimum(255.0f, greenWeight * color) / 255;
-			const float b = minimum(255.0f, blueWeight * color) / 255;
-
-			glColor3f(r, g, b);
-			glVertex2f((GLfloat)x, (GLfloat)y);
-		}
-	}
+	glEnable(GL_TEXTURE_2D);
+	glBindTexture(GL_TEXTURE_2D, display->texture);
+	glBegin(GL_QUADS);
+	glTexCoord2f(0.0f, 0.0f); glVertex2f(-1.0f, -1.0f);
+	glTexCoord2f(u, 0.0f); glVertex2f(1.0f, -1.0f);
+	glTexCoord2f(u, v); glVertex2f(1.0f, 1.0f);
+	glTexCoord2f(0.0f, v); glVertex2f(-1.0f, 1.0f);
 	glEnd();
+	glDisable(GL_TEXTURE_2D);
 }
 
 
@@ -220,53 +274,147 @@ void handleSliderEvent(GLFWwindow* window, Slider* slider) {
 }
 
 
+//what the window asks the render thread for, only touched on this thread
+RenderRequest request;
+
+
+//seconds the size has to stay the same before the full size is rendered
+#define RESIZE_SETTLE 0.15
+double resizedAt;
+
+//while the size keeps changing only quarter size previews are rendered, the old frame is stretched meanwhile
 void framebuffer_size_callback(GLFWwindow* window, int width, int height){
 	glViewport(0, 0, width, height);
-	Screen* screen = (Screen*)glfwGetWindowUserPointer(window);
-	glfwGetFramebufferSize(window, &screen->width, &screen->height);
-	screen->colors = (float *)realloc(screen->colors, screen->width * screen->height * sizeof(float));
-	MandelbrotSet(width, height, screen->colors);
-	glfwSetWindowUserPointer(window, screen);
+	Renderer* renderer = (Renderer*)glfwGetWindowUserPointer(window);
+	glfwGetFramebufferSize(window, &width, &height);
+	request.width = width;
+	request.height = height;
+	request.preview = true;
+	resizedAt = glfwGetTime();
+	RendererPost(renderer, &request);
 }
 
+//called every frame, asks for the full size once the resize has settled
+void settleResize(Renderer* renderer) {
+	if (!request.preview || glfwGetTime() - resizedAt < RESIZE_SETTLE)
+		return;
+	request.preview = false;
+	RendererPost(renderer, &request);
+}
+
+
+void updateTitle(GLFWwindow* window) {
+	const Fractal* f = &request.fractal;
+	char name[64], title[192];
+	if (f->family == FRACTAL_JULIA)
+		snprintf(name, sizeof(name), "Julia Set z^%d + (%.4g, %.4g)", f->exponent, f->juliaReal, f->juliaImag);
+	else
+		snprintf(name, sizeof(name), f->exponent == 2 ? "Mandelbrot Set" : "Multibrot Set z^%d", f->exponent);
 
-float MapRange(float from_x1, float from_x2, float to_x1, float to_x2, float x) {
-	return (to_x2 - to_x1) / (from_x2 - from_x1) * (x - from_x1) + to_x1;
+	char smoothing[64] = "";
+	if (request.antialias.samples > 1)
+		snprintf(smoothing, sizeof(smoothing), ", %dx %s antialiasing", request.antialias.samples, SamplePatternName(request.antialias.pattern));
+	if (request.equalize)
+		strcat(smoothing, ", equalized");
+
+	snprintf(title, sizeof(title), "%s - width %.3g, %d iterations, %s%s%s", name, request.view.spanReal, request.maxIterations,
+		RenderModeName(request.mode), FractalIsMandelbrot(f) && ViewportIsDeep(&request.view, request.width) ? " (perturbation)" : "", smoothing);
+	glfwSetWindowTitle(window, title);
 }
 
-void scroll_callback(GLFWwindow* window, double xoffset, double yoffset){
-	double xCoord, yCoord;
-	glfwGetCursorPos(window, &xCoord, &yCoord);
-	float zoomSize = 2.0f;
-	Screen* screen = (Screen*)glfwGetWindowUserPointer(window);
+//starting view of a fractal family
+void resetView(void) {
+	if (request.fractal.family == FRACTAL_JULIA)
+		ViewportInit(&request.view, -2.0, -2.0, 2.0, 2.0);
+	else
+		ViewportInit(&request.view, -2.5, -2.0, 1.0, 2.0);
+	request.view.spanImag = request.view.spanReal * request.height / request.width;
+}
 
-	float cx = MapRange(0, (float)screen->width, start.real, end.real, (float)xCoord);
-	float cy = MapRange(0, (float)screen->height, start.imag, end.imag, screen->width - (float)yCoord);
+//M cycles brute force, subdivision and distance estimation, V toggles checking subdivision fills against brute
+//force, I toggles the interior shortcuts, + and - double and halve the iteration limit. F switches between the
+//Mandelbrot and Julia families, 2 to 8 pick the exponent and J shows the Julia set of the point under the cursor.
+//A cycles antialiasing off, 4 and 16 samples per edge pixel, P the sample pattern. H toggles histogram equalized colors
+void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods) {
+	if (action != GLFW_PRESS && action != GLFW_REPEAT)
+		return;
+
+	Renderer* renderer = (Renderer*)glfwGetWindowUserPointer(window);
+	if (key == GLFW_KEY_EQUAL || key == GLFW_KEY_KP_ADD || key == GLFW_KEY_MINUS || key == GLFW_KEY_KP_SUBTRACT) {
+		bool raise = key == GLFW_KEY_EQUAL || key == GLFW_KEY_KP_ADD;
+		int iterations = request.maxIterations;
+		request.maxIterations = raise ? minimum(iterations * 2, 1 << 24) : (iterations > 16 ? iterations / 2 : iterations);
+	}
+	else if (action != GLFW_PRESS) {
+		return;
+	}
+	else if (key == GLFW_KEY_M) {
+		request.mode = (RenderMode)((request.mode + 1) % RENDER_MODE_COUNT);
+	}
+	else if (key == GLFW_KEY_V) {
+		request.verify = !request.verify;
+	}
+	else if (key == GLFW_KEY_I) {
+		request.shortcuts = !request.shortcuts;
+	}
+	else if (key == GLFW_KEY_A) {
+		int samples = request.antialias.samples;
+		request.antialias.samples = samples < 4 ? 4 : samples < 16 ? 16 : 0;
+	}
+	else if (key == GLFW_KEY_P) {
+		request.antialias.pattern = (SamplePattern)((request.antialias.pattern + 1) % SAMPLE_PATTERN_COUNT);
+	}
+	else if (key == GLFW_KEY_H) {
+		request.equalize = !request.equalize;
+	}
+	else if (key == GLFW_KEY_F) {
+		request.fractal.family = (FractalFamily)((request.fractal.family + 1) % FRACTAL_FAMILY_COUNT);
+		resetView();
+	}
+	else if (key >= GLFW_KEY_2 && key <= GLFW_KEY_0 + MAX_EXPONENT) {
+		request.fractal.exponent = key - GLFW_KEY_0;
+	}
+	else if (key == GLFW_KEY_J) {
+		//rows are drawn bottom up while the cursor is measured from the top
+		double xCoord, yCoord;
+		glfwGetCursorPos(window, &xCoord, &yCoord);
+		double x = xCoord / request.width - 0.5, y = (request.height - yCoord) / request.height - 0.5;
+		request.fractal.juliaReal = FixedToDouble(request.view.centerReal) + x * request.view.spanReal;
+		request.fractal.juliaImag = FixedToDouble(request.view.centerImag) + y * request.view.spanImag;
+		request.fractal.family = FRACTAL_JULIA;
+		resetView();
+	}
+	else {
+		return;
+	}
 
-	start.real -= cx;
-	end.real -= cx;
-	start.imag -= cy;
-	end.imag -= cy;
+	//the render thread prints the stats once the frame is done
+	RendererPost(renderer, &request);
+	updateTitle(window);
+}
 
-	float factor = yoffset > 0 ? 0.9f : 1.1f;
+void scroll_callback(GLFWwindow* window, double xoffset, double yoffset){
+	double xCoord, yCoord;
+	glfwGetCursorPos(window, &xCoord, &yCoord);
+	Renderer* renderer = (Renderer*)glfwGetWindowUserPointer(window);
 
-	start.real *= factor;
-	end.real *= factor;
-	start.imag *= factor;
-	end.imag *= factor;
+	//rows are drawn bottom up while the cursor is measured from the top
+	double x = xCoord / request.width;
+	double y = (request.height - yCoord) / request.height;
 
-	start.real += cx;
-	end.real += cx;
-	start.imag += cy;
-	end.imag += cy;
+	double factor = yoffset > 0 ? 0.9 : 1.1;
+	ViewportZoom(&request.view, x, y, factor);
 
-	MandelbrotSet(screen->width, screen->height, screen->colors);
+	//tiles of the previous viewport that have not started yet are dropped
+	RendererPost(renderer, &request);
+	updateTitle(window);
 }
 
 
 
 int main(int argc, char* argv[]) {
-	Screen screen;
+	Renderer renderer;
+	Display display = { 0 };
 
 	//width and height
 	int width = 800;
@@ -274,30 +422,51 @@ int main(int argc, char* argv[]) {
 
 	GLFWwindow* window;
 
+	//headless modes need neither a window nor a screen
+	if (argc > 1 && (strcmp(argv[1], "poster") == 0 || strcmp(argv[1], "benchmark") == 0 || strcmp(argv[1], "buddhabrot") == 0 || strcmp(argv[1], "serve") == 0 ||
+		strcmp(argv[1], "zoom") == 0)) {
+		PoolInit(0);
+		int result = strcmp(argv[1], "poster") == 0 ? PosterMain(argc - 2, argv + 2) :
+			strcmp(argv[1], "buddhabrot") == 0 ? BuddhabrotMain(argc - 2, argv + 2) :
+			strcmp(argv[1], "serve") == 0 ? ServerMain(argc - 2, argv + 2) :
+			strcmp(argv[1], "zoom") == 0 ? ZoomMain(argc - 2, argv + 2) : BenchmarkMain(argc - 2, argv + 2);
+		PoolShutdown();
+		return result;
+	}
+
 	if (!glfwInit())
 		return -1;
 
-	window = glfwCreateWindow(width, height, "Mandelbrot Set", NULL, NULL);
+	//one render thread per core, tiles are shared out with work stealing
+	PoolInit(0);
 
-	screen.colors = (float*)malloc(width * height * sizeof(float));
+	window = glfwCreateWindow(width, height, "Mandelbrot Set", NULL, NULL);
 
 	if (!window) {
 		glfwTerminate();
 		return -1;
 	}
-	screen.width = width;
-	screen.height = height;
 
-	glfwSetWindowUserPointer(window, &screen);
+	request.width = width;
+	request.height = height;
+	request.fractal = fractal;
+	resetView();
+	request.maxIterations = maxIter;
+	request.mode = renderMode;
+	request.verify = verifySubdivision;
+	request.shortcuts = interiorShortcuts;
+	request.antialias = antialias;
+	if (!RendererStart(&renderer, &request)) {
+		glfwTerminate();
+		return -1;
+	}
+
+	glfwSetWindowUserPointer(window, &renderer);
 	glfwSetWindowSizeCallback(window, framebuffer_size_callback);
 
 	glfwMakeContextCurrent(window);
 	glViewport(0, 0, width, height);
-
-	start = initComplex(-2.5f, -2);
-	end = initComplex(1.0f, 2.0f);
-
-	MandelbrotSet(screen.width, screen.height, screen.colors);
+	initDisplay(&display);
 
 	Slider sliders[3];
 	for (int i = 0; i < 3; i++) {
@@ -322,6 +491,8 @@ int main(int argc, char* argv[]) {
 	}
 
 	glfwSetScrollCallback(window, scroll_callback);
+	glfwSetKeyCallback(window, key_callback);
+	updateTitle(window);
 
 
 	while (!glfwWindowShouldClose(window)) {
@@ -329,7 +500,7 @@ int main(int argc, char* argv[]) {
 
 		glClearColor(0.3f, 0.3f, 0.3f, 1.0f);
 
-		rendermandelbrot(screen.colors, screen.width, screen.height);
+		rendermandelbrot(&display, &renderer);
 
 		for (int i = 0; i < 3; i++) {
 			renderSlider(&sliders[i]);
@@ -338,12 +509,16 @@ int main(int argc, char* argv[]) {
 		glfwSwapBuffers(window);
 
 		glfwPollEvents();
+		settleResize(&renderer);
 
 		for (int i = 0; i < 3; i++) {
 			handleSliderEvent(window, &sliders[i]);
 		}
 	}
 
+	RendererStop(&renderer);
+	destroyDisplay(&display);
 	glfwTerminate();
+	PoolShutdown();
 	return 0;
 }
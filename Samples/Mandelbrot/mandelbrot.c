@@ -0,0 +1,832 @@
+#include "mandelbrot.h"
+
+#include <math.h>
+#include <float.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+int maxIter = 100;
+Viewport view;
+KernelType activeKernel = KERNEL_COUNT;
+
+
+Complex initComplex(float real, float imag) {
+	Complex c;
+	c.real = real;
+	c.imag = imag;
+
+	return c;
+}
+
+
+Complex add(Complex c1, Complex c2) {
+	Complex result;
+	result.real = c1.real + c2.real;
+	result.imag = c1.imag + c2.imag;
+
+	return result;
+}
+
+Complex multiply(Complex c1, Complex c2) {
+	Complex result;
+	result.real = c1.real * c2.real - c1.imag * c2.imag;
+	result.imag = c1.real * c2.imag + c1.imag * c2.real;
+
+	return result;
+}
+
+float absolute(Complex c) {
+	double real = (double)c.real;
+	double imag = (double)c.imag;
+	float magnitude = sqrt(real * real + imag * imag);
+	return magnitude;
+}
+
+
+int doesDiverge(Complex* c, float radius) {
+	Complex z = initComplex(0.0f, 0.0f);
+	int iter = 0;
+
+	while (absolute(z) <= radius && iter < maxIter) {
+		z = add(multiply(z, z), *c);
+		iter += 1;
+	}
+
+	//for returning complex number
+	*c = z;
+
+	return iter;
+}
+
+
+void ViewportInit(Viewport* viewport, double startReal, double startImag, double endReal, double endImag) {
+	viewport->centerReal = FixedFromDouble((startReal + endReal) / 2);
+	viewport->centerImag = FixedFromDouble((startImag + endImag) / 2);
+	viewport->spanReal = endReal - startReal;
+	viewport->spanImag = endImag - startImag;
+}
+
+Complex ViewportStart(const Viewport* viewport) {
+	return initComplex((float)(FixedToDouble(viewport->centerReal) - viewport->spanReal / 2),
+		(float)(FixedToDouble(viewport->centerImag) - viewport->spanImag / 2));
+}
+
+Complex ViewportEnd(const Viewport* viewport) {
+	return initComplex((float)(FixedToDouble(viewport->centerReal) + viewport->spanReal / 2),
+		(float)(FixedToDouble(viewport->centerImag) + viewport->spanImag / 2));
+}
+
+void ViewportZoom(Viewport* viewport, double x, double y, double factor) {
+	//the point under the cursor stays where it is
+	double offsetReal = (x - 0.5) * viewport->spanReal;
+	double offsetImag = (y - 0.5) * viewport->spanImag;
+
+	viewport->centerReal = FixedAdd(viewport->centerReal, FixedFromDouble(offsetReal * (1.0 - factor)));
+	viewport->centerImag = FixedAdd(viewport->centerImag, FixedFromDouble(offsetImag * (1.0 - factor)));
+	viewport->spanReal *= factor;
+	viewport->spanImag *= factor;
+}
+
+bool ViewportIsDeep(const Viewport* viewport, int width) {
+	double magnitude = fabs(FixedToDouble(viewport->centerReal)) + fabs(FixedToDouble(viewport->centerImag)) + 1.0;
+	double pixel = viewport->spanReal / (width > 0 ? width : 1);
+	//a few float ulps per pixel still give a clean image
+	return pixel < 16 * FLT_EPSILON * magnitude;
+}
+
+
+Fractal fractal = { FRACTAL_MANDELBROT, 2, -0.8, 0.156 };
+
+const char* FractalName(const Fractal* f) {
+	if (f->family == FRACTAL_JULIA)
+		return "Julia";
+	return f->exponent == 2 ? "Mandelbrot" : "Multibrot";
+}
+
+bool FractalIsMandelbrot(const Fractal* f) {
+	return f->family == FRACTAL_MANDELBROT && f->exponent == 2;
+}
+
+
+bool interiorShortcuts = true;
+
+bool InMainCardioid(double real, double imag) {
+	double x = real - 0.25;
+	double q = x * x + imag * imag;
+	return q * (q + x) <= 0.25 * imag * imag;
+}
+
+bool InPeriod2Bulb(double real, double imag) {
+	double x = real + 1.0;
+	return x * x + imag * imag <= 1.0 / 16;
+}
+
+
+//float path: pixel coordinates in float, escape loop in the selected kernel
+static void KernelPixels(RenderContext* context, const int* xs, const int* ys, int count, PixelOrbit* orbits, int* iterations, Shade* colors, RenderStats* stats) {
+	float cReal[TILE_SIZE], cImag[TILE_SIZE], zReal[TILE_SIZE], zImag[TILE_SIZE];
+	int pending[TILE_SIZE], pendingIterations[TILE_SIZE];
+	const float radius = context->radius;
+
+	for (int begin = 0; begin < count; begin += TILE_SIZE) {
+		int n = minimum(TILE_SIZE, count - begin);
+
+		//pixels caught by the interior tests are finished here, the rest is packed for the kernel
+		int pendingCount = 0;
+		for (int i = 0; i < n; i++) {
+			PixelOrbit* orbit = orbits ? &orbits[begin + i] : NULL;
+			float real = context->start.real + ((float)xs[begin + i] / context->width) * (context->end.real - context->start.real);
+			float imag = context->start.imag + ((float)ys[begin + i] / context->height) * (context->end.imag - context->start.imag);
+			bool interior = orbit && orbit->reference == ORBIT_INTERIOR;
+			if (!interior && context->interiorTests) {
+				bool cardioid = InMainCardioid(real, imag);
+				if (cardioid || InPeriod2Bulb(real, imag)) {
+					if (cardioid)
+						stats->cardioid += 1;
+					else
+						stats->bulb += 1;
+					interior = true;
+				}
+			}
+			if (interior) {
+				if (orbit) {
+					orbit->iterations = maxIter;
+					orbit->reference = ORBIT_INTERIOR;
+				}
+				iterations[begin + i] = maxIter;
+				colors[begin + i] = SHADE_INTERIOR;
+				continue;
+			}
+
+			//Julia sets start z at the pixel and share one c
+			bool fresh = !orbit || orbit->iterations == 0;
+			cReal[pendingCount] = context->julia ? context->juliaC.real : real;
+			cImag[pendingCount] = context->julia ? context->juliaC.imag : imag;
+			zReal[pendingCount] = !fresh ? (float)orbit->zReal : context->julia ? real : 0.0f;
+			zImag[pendingCount] = !fresh ? (float)orbit->zImag : context->julia ? imag : 0.0f;
+			pendingIterations[pendingCount] = fresh ? 0 : orbit->iterations;
+			pending[pendingCount] = begin + i;
+			pendingCount += 1;
+		}
+
+		stats->periodic += context->kernel(cReal, cImag, zReal, zImag, pendingIterations, pendingCount, maxIter, radius, context->shortcuts);
+
+		for (int i = 0; i < pendingCount; i++) {
+			int iter = minimum(pendingIterations[i], maxIter);
+			Complex z = initComplex(zReal[i], zImag[i]);
+			iterations[pending[i]] = iter;
+			if (orbits) {
+				PixelOrbit* orbit = &orbits[pending[i]];
+				orbit->iterations = iter;
+				orbit->zReal = z.real;
+				orbit->zImag = z.imag;
+				orbit->reference = pendingIterations[i] > maxIter ? ORBIT_INTERIOR : 0;
+			}
+			if (iter >= maxIter) {
+				colors[pending[i]] = SHADE_INTERIOR;
+				continue;
+			}
+			colors[pending[i]] = ShadeFromValue((float)((iter - log2(absolute(z) / radius)) / maxIter) * 255);
+		}
+	}
+}
+
+
+RenderMode renderMode = RENDER_BRUTE_FORCE;
+bool verifySubdivision = false;
+RenderStats renderStats;
+
+void RenderStatsAdd(RenderStats* total, const RenderStats* stats) {
+	total->computed += stats->computed;
+	total->filled += stats->filled;
+	total->mismatched += stats->mismatched;
+	total->cardioid += stats->cardioid;
+	total->bulb += stats->bulb;
+	total->periodic += stats->periodic;
+	total->rebases += stats->rebases;
+	total->supersampled += stats->supersampled;
+}
+
+const char* RenderModeName(RenderMode mode) {
+	switch (mode) {
+	case RENDER_BRUTE_FORCE: return "brute force";
+	case RENDER_SUBDIVIDE: return "subdivision";
+	case RENDER_DISTANCE: return "distance estimation";
+	default: return "unknown";
+	}
+}
+
+void TileOrbitsAppend(TileOrbits* orbits, const PixelOrbit* orbit) {
+	if (orbits->count == orbits->capacity) {
+		orbits->capacity = orbits->capacity ? orbits->capacity * 2 : 64;
+		orbits->items = (PixelOrbit*)realloc(orbits->items, orbits->capacity * sizeof(PixelOrbit));
+	}
+	orbits->items[orbits->count++] = *orbit;
+}
+
+typedef struct RenderJob {
+	RenderContext* context;
+	Shade* colors;
+	const int* tiles;
+	TileOrbits* orbits;		//per tile index, NULL when not kept
+	EdgeSamples* samples;	//where SampleTile keeps the samples
+	RenderMode mode;
+	RenderStats* stats;		//one per worker
+	const RenderCancel* cancel;
+	volatile int32_t skipped;
+}RenderJob;
+
+static bool SkipTile(RenderJob* job) {
+	if (!job->cancel || AtomicLoad(job->cancel->generation) == job->cancel->expected)
+		return false;
+	AtomicStore(&job->skipped, 1);
+	return true;
+}
+
+static void RenderTile(void* data, int item, int worker) {
+	RenderJob* job = (RenderJob*)data;
+	RenderContext* context = job->context;
+	if (SkipTile(job))
+		return;
+	int index = job->tiles ? job->tiles[item] : item;
+	Tile tile = TileGet(index, context->width, context->height, TILE_SIZE);
+	TileOrbits* orbits = job->orbits ? &job->orbits[index] : NULL;
+	if (orbits)
+		orbits->count = 0;
+
+	if (job->mode == RENDER_SUBDIVIDE) {
+		SubdivideTile(context, tile, job->colors, &job->stats[worker], orbits);
+		return;
+	}
+
+	int xs[TILE_SIZE], ys[TILE_SIZE], iterations[TILE_SIZE];
+	PixelOrbit row[TILE_SIZE];
+	int count = tile.x1 - tile.x0;
+	for (int i = 0; i < count; i++) {
+		xs[i] = tile.x0 + i;
+	}
+	for (int y = tile.y0; y < tile.y1; y++) {
+		for (int i = 0; i < count; i++) {
+			ys[i] = y;
+		}
+		if (orbits)
+			memset(row, 0, count * sizeof(PixelOrbit));
+		context->pixels(context, xs, ys, count, orbits ? row : NULL, iterations, job->colors + y * context->width + tile.x0, &job->stats[worker]);
+
+		for (int i = 0; orbits && i < count; i++) {
+			if (row[i].iterations >= maxIter && row[i].reference != ORBIT_INTERIOR) {
+				row[i].index = xs[i] + y * context->width;
+				TileOrbitsAppend(orbits, &row[i]);
+			}
+		}
+	}
+	job->stats[worker].computed += count * (tile.y1 - tile.y0);
+}
+
+//continues the kept orbits of one tile, the ones still unresolved stay in the list
+static void ResumeTile(void* data, int item, int worker) {
+	RenderJob* job = (RenderJob*)data;
+	RenderContext* context = job->context;
+	if (SkipTile(job))
+		return;
+	TileOrbits* orbits = &job->orbits[job->tiles[item]];
+	int xs[TILE_SIZE], ys[TILE_SIZE], iterations[TILE_SIZE];
+	Shade colors[TILE_SIZE];
+	int kept = 0;
+
+	for (int begin = 0; begin < orbits->count; begin += TILE_SIZE) {
+		PixelOrbit* batch = orbits->items + begin;
+		int n = minimum(TILE_SIZE, orbits->count - begin);
+		for (int i = 0; i < n; i++) {
+			xs[i] = batch[i].index % context->width;
+			ys[i] = batch[i].index / context->width;
+		}
+
+		context->pixels(context, xs, ys, n, batch, iterations, colors, &job->stats[worker]);
+
+		for (int i = 0; i < n; i++) {
+			job->colors[batch[i].index] = colors[i];
+			if (batch[i].iterations >= maxIter && batch[i].reference != ORBIT_INTERIOR)
+				orbits->items[kept++] = batch[i];
+		}
+		job->stats[worker].computed += n;
+	}
+	orbits->count = kept;
+}
+
+//supersamples the edge pixels of one tile, the orbit lists hold the edges
+static void SampleTile(void* data, int item, int worker) {
+	RenderJob* job = (RenderJob*)data;
+	if (SkipTile(job))
+		return;
+	EdgeSamples* samples = job->samples;
+	Shade* shades = samples->shades + (size_t)samples->tileStarts[item] * samples->samples;
+	SupersampleTile(job->context, &job->orbits[item], job->colors, shades, &job->stats[worker]);
+}
+
+//renders the listed pixels of one tile, the orbit lists hold pixel indices
+static void PixelsTile(void* data, int item, int worker) {
+	RenderJob* job = (RenderJob*)data;
+	RenderContext* context = job->context;
+	if (SkipTile(job))
+		return;
+	const TileOrbits* pixels = &job->orbits[item];
+	int xs[TILE_SIZE], ys[TILE_SIZE], iterations[TILE_SIZE];
+	Shade colors[TILE_SIZE];
+
+	for (int begin = 0; begin < pixels->count; begin += TILE_SIZE) {
+		const PixelOrbit* batch = pixels->items + begin;
+		int n = minimum(TILE_SIZE, pixels->count - begin);
+		for (int i = 0; i < n; i++) {
+			xs[i] = batch[i].index % context->width;
+			ys[i] = batch[i].index / context->width;
+		}
+
+		context->pixels(context, xs, ys, n, NULL, iterations, colors, &job->stats[worker]);
+
+		for (int i = 0; i < n; i++) {
+			job->colors[batch[i].index] = colors[i];
+		}
+		job->stats[worker].computed += n;
+	}
+}
+
+static bool RunTiles(JobProc proc, const Viewport* viewport, int width, int height, Shade* colors, const int* tiles, int tileCount, TileOrbits* orbits, EdgeSamples* samples, const RenderCancel* cancel) {
+	RenderContext context = { 0 };
+	context.width = width;
+	context.height = height;
+	context.distance = renderMode == RENDER_DISTANCE;
+	context.radius = context.distance ? DISTANCE_RADIUS : 4.0f;
+	context.shortcuts = interiorShortcuts;
+	context.centerReal = FixedToDouble(viewport->centerReal);
+	context.centerImag = FixedToDouble(viewport->centerImag);
+	context.spanReal = viewport->spanReal;
+	context.spanImag = viewport->spanImag;
+	context.pixelWidth = viewport->spanReal / width;
+
+	bool deep = ViewportIsDeep(viewport, width) && FractalIsMandelbrot(&fractal);
+	if (deep) {
+		PerturbationBegin(&context, viewport);
+	}
+	else {
+		if (activeKernel == KERNEL_COUNT)
+			activeKernel = BestKernel();
+		context.pixels = context.distance ? DistancePixels : KernelPixels;
+		context.kernel = GetPowerKernel(activeKernel, fractal.exponent);
+		context.start = ViewportStart(viewport);
+		context.end = ViewportEnd(viewport);
+		context.interiorTests = interiorShortcuts && FractalIsMandelbrot(&fractal);
+		context.julia = fractal.family == FRACTAL_JULIA;
+		context.juliaC = initComplex((float)fractal.juliaReal, (float)fractal.juliaImag);
+		context.exponent = fractal.exponent;
+	}
+
+	RenderJob job;
+	job.context = &context;
+	job.colors = colors;
+	job.tiles = tiles;
+	job.orbits = orbits;
+	job.samples = samples;
+	job.mode = renderMode;
+	job.stats = (RenderStats*)calloc(PoolWorkerCount(), sizeof(RenderStats));
+	job.cancel = cancel;
+	job.skipped = 0;
+
+	PoolRun(proc, &job, tileCount);
+
+	if (deep)
+		PerturbationEnd(&context);
+
+	RenderStats total = { 0 };
+	for (int i = 0; i < PoolWorkerCount(); i++) {
+		RenderStatsAdd(&total, &job.stats[i]);
+	}
+	renderStats = total;
+	free(job.stats);
+	return !job.skipped;
+}
+
+bool RenderTiles(const Viewport* viewport, int width, int height, Shade* colors, const int* tiles, int tileCount, TileOrbits* orbits, const RenderCancel* cancel) {
+	if (!tiles)
+		tileCount = TileCount(width, height, TILE_SIZE);
+	return RunTiles(RenderTile, viewport, width, height, colors, tiles, tileCount, orbits, NULL, cancel);
+}
+
+bool ResumeTiles(const Viewport* viewport, int width, int height, Shade* colors, const int* tiles, int tileCount, TileOrbits* orbits, const RenderCancel* cancel) {
+	return RunTiles(ResumeTile, viewport, width, height, colors, tiles, tileCount, orbits, NULL, cancel);
+}
+
+bool RenderPixels(const Viewport* viewport, int width, int height, Shade* colors, TileOrbits* pixels, const RenderCancel* cancel) {
+	return RunTiles(PixelsTile, viewport, width, height, colors, NULL, TileCount(width, height, TILE_SIZE), pixels, NULL, cancel);
+}
+
+bool AntialiasFrame(const Viewport* viewport, int width, int height, Shade* colors, EdgeSamples* samples, const RenderCancel* cancel) {
+	int tileCount = TileCount(width, height, TILE_SIZE);
+	TileOrbits* edges = (TileOrbits*)calloc(tileCount, sizeof(TileOrbits));
+	//every edge is found before the first pixel is replaced by its samples
+	FindEdges(colors, width, height, edges);
+	EdgeSamplesPrepare(samples, edges, tileCount);
+
+	RenderStats stats = renderStats;
+	bool finished = RunTiles(SampleTile, viewport, width, height, colors, NULL, tileCount, edges, samples, cancel);
+	RenderStatsAdd(&stats, &renderStats);
+	renderStats = stats;
+	//skipped tiles left their samples unwritten
+	if (!finished)
+		samples->count = 0;
+
+	for (int i = 0; i < tileCount; i++) {
+		free(edges[i].items);
+	}
+	free(edges);
+	return finished;
+}
+
+void MandelbrotSet(int width, int height, Shade* colors) {
+	RenderTiles(&view, width, height, colors, NULL, 0, NULL, NULL);
+}
+
+
+Shade ShadeFromValue(float value) {
+	if (!(value > 0.0f))
+		return 0;
+	if (value >= 255.0f)
+		return SHADE_INTERIOR;
+	return (Shade)(value * SHADE_ONE + 0.5f);
+}
+
+static void PaletteEntry(uint8_t* entry, const float weights[3], float value) {
+	entry[0] = (uint8_t)minimum(255.0f, weights[0] * value);
+	entry[1] = (uint8_t)minimum(255.0f, weights[1] * value);
+	entry[2] = (uint8_t)minimum(255.0f, weights[2] * value);
+	entry[3] = 255;
+}
+
+bool PaletteUpdate(Palette* palette, const float weights[3]) {
+	if (palette->entries && palette->weights[0] == weights[0] && palette->weights[1] == weights[1] && palette->weights[2] == weights[2])
+		return false;
+
+	if (!palette->entries)
+		palette->entries = (uint8_t*)malloc(SHADE_LEVELS * 4);
+	for (int shade = 0; shade < SHADE_LEVELS; shade++) {
+		PaletteEntry(palette->entries + shade * 4, weights, (float)shade / SHADE_ONE);
+	}
+	palette->weights[0] = weights[0];
+	palette->weights[1] = weights[1];
+	palette->weights[2] = weights[2];
+	return true;
+}
+
+bool PaletteWeightsValid(const float weights[3]) {
+	for (int i = 0; i < 3; i++) {
+		//false for nan too
+		if (!(weights[i] >= 0.0f && weights[i] <= PALETTE_MAX_WEIGHT))
+			return false;
+	}
+	return true;
+}
+
+void PaletteEqualize(Palette* palette, const float weights[3], const uint32_t* cumulative) {
+	if (!palette->entries)
+		palette->entries = (uint8_t*)malloc(SHADE_LEVELS * 4);
+	float strongest = weights[0] > weights[1] ? weights[0] : weights[1];
+	strongest = strongest > weights[2] ? strongest : weights[2];
+	const float top = strongest > 1.0f ? 255.0f / strongest : 255.0f;
+	const uint32_t total = cumulative[SHADE_LEVELS - 1];
+
+	for (int shade = 0; shade < SHADE_LEVELS; shade++) {
+		float value = (float)shade / SHADE_ONE;
+		if (shade < SHADE_INTERIOR)
+			value = total ? top * (float)((double)cumulative[shade] / total) : 0.0f;
+		PaletteEntry(palette->entries + shade * 4, weights, value);
+	}
+}
+
+void PaletteFree(Palette* palette) {
+	free(palette->entries);
+	palette->entries = NULL;
+}
+
+
+typedef struct ColorizeJob {
+	const Shade* colors;
+	const Palette* palette;
+	uint8_t* pixels;
+	int width, height, channels;
+}ColorizeJob;
+
+void ColorizePixels(const Shade* colors, int count, const Palette* palette, uint8_t* pixels, int channels) {
+	const uint8_t* entries = palette->entries;
+	if (channels == 4) {
+		for (int i = 0; i < count; i++) {
+			memcpy(pixels + (size_t)i * 4, entries + colors[i] * 4, 4);
+		}
+		return;
+	}
+	for (int i = 0; i < count; i++) {
+		const uint8_t* entry = entries + colors[i] * 4;
+		uint8_t* pixel = pixels + (size_t)i * 3;
+		pixel[0] = entry[0];
+		pixel[1] = entry[1];
+		pixel[2] = entry[2];
+	}
+}
+
+//one band of TILE_SIZE rows
+static void ColorizeRows(void* data, int item, int worker) {
+	ColorizeJob* job = (ColorizeJob*)data;
+	int begin = item * TILE_SIZE * job->width;
+	int end = minimum(job->height, (item + 1) * TILE_SIZE) * job->width;
+	ColorizePixels(job->colors + begin, end - begin, job->palette, job->pixels + (size_t)begin * job->channels, job->channels);
+}
+
+void ColorizeFrame(const Shade* colors, int width, int height, const Palette* palette, uint8_t* pixels, int channels) {
+	ColorizeJob job;
+	job.colors = colors;
+	job.palette = palette;
+	job.pixels = pixels;
+	job.width = width;
+	job.height = height;
+	job.channels = channels;
+	PoolRun(ColorizeRows, &job, (height + TILE_SIZE - 1) / TILE_SIZE);
+}
+
+
+static void ClearOrbits(Screen* screen) {
+	for (int i = 0; i < screen->tileCount; i++) {
+		screen->orbits[i].count = 0;
+	}
+}
+
+void ScreenResize(Screen* screen, int width, int height) {
+	int count = width * height;
+	int tiles = TileCount(width, height, TILE_SIZE);
+	screen->width = width;
+	screen->height = height;
+
+	//buffers grow by at least half, dragging a window edge only reallocates now and then
+	if (count > screen->capacity) {
+		screen->capacity = count > screen->capacity * 3 / 2 ? count : screen->capacity * 3 / 2;
+		screen->colors = (Shade*)realloc(screen->colors, screen->capacity * sizeof(Shade));
+		screen->scratchColors = (Shade*)realloc(screen->scratchColors, screen->capacity * sizeof(Shade));
+		screen->state = (uint8_t*)realloc(screen->state, screen->capacity);
+		screen->scratchState = (uint8_t*)realloc(screen->scratchState, screen->capacity);
+	}
+	if (tiles > screen->tileCount) {
+		int capacity = tiles > screen->tileCount * 3 / 2 ? tiles : screen->tileCount * 3 / 2;
+		screen->pending = (int*)realloc(screen->pending, capacity * sizeof(int));
+		screen->orbits = (TileOrbits*)realloc(screen->orbits, capacity * sizeof(TileOrbits));
+		memset(screen->orbits + screen->tileCount, 0, (capacity - screen->tileCount) * sizeof(TileOrbits));
+		screen->tileCount = capacity;
+	}
+	ClearOrbits(screen);
+	memset(screen->colors, 0, count * sizeof(Shade));
+	memset(screen->state, PIXEL_MISSING, count);
+	screen->pendingCount = 0;
+	screen->pendingMissing = 0;
+	screen->pendingNext = 0;
+	screen->antialiased = false;
+	screen->revision += 1;
+}
+
+//queues every tile, the first missing of them are rendered without a time budget
+static void QueueAllTiles(Screen* screen, int missing) {
+	int tileCount = TileCount(screen->width, screen->height, TILE_SIZE);
+	for (int i = 0; i < tileCount; i++) {
+		screen->pending[i] = i;
+	}
+	screen->pendingCount = tileCount;
+	screen->pendingMissing = minimum(missing, tileCount);
+	screen->pendingNext = 0;
+}
+
+//exact pixels stay up as a preview until their tile is rendered again
+static void DemoteExact(Screen* screen) {
+	const int count = screen->width * screen->height;
+	for (int i = 0; i < count; i++) {
+		if (screen->state[i] == PIXEL_EXACT)
+			screen->state[i] = PIXEL_PREVIEW;
+	}
+}
+
+void ScreenRender(Screen* screen, const Viewport* viewport) {
+	if (memcmp(&screen->view, viewport, sizeof(Viewport)) != 0)
+		memset(screen->state, PIXEL_MISSING, screen->width * screen->height);
+	else
+		DemoteExact(screen);
+	screen->view = *viewport;
+	screen->maxIterations = maxIter;
+	ClearOrbits(screen);
+
+	//one run over every tile, as ScreenRefine does for the tiles that cannot wait
+	QueueAllTiles(screen, screen->tileCount);
+	ScreenRefine(screen, 0.0);
+}
+
+void ScreenReproject(Screen* screen, const Viewport* viewport) {
+	const int width = screen->width, height = screen->height;
+	const Viewport* old = &screen->view;
+
+	Shade* colors = screen->scratchColors;
+	uint8_t* state = screen->scratchState;
+	screen->scratchColors = screen->colors;
+	screen->scratchState = screen->state;
+	screen->colors = colors;
+	screen->state = state;
+	const Shade* oldColors = screen->scratchColors;
+	const uint8_t* oldState = screen->scratchState;
+
+	//new pixel x sits at old pixel (x / width - 0.5) * scale + offset + 0.5, times width
+	double offsetReal = FixedToDouble(FixedSub(viewport->centerReal, old->centerReal)) / old->spanReal;
+	double offsetImag = FixedToDouble(FixedSub(viewport->centerImag, old->centerImag)) / old->spanImag;
+	double scaleReal = viewport->spanReal / old->spanReal;
+	double scaleImag = viewport->spanImag / old->spanImag;
+	bool identity = offsetReal == 0.0 && offsetImag == 0.0 && scaleReal == 1.0 && scaleImag == 1.0;
+
+	//the mapping is separable, so source columns are looked up once per frame
+	int* sourceX = (int*)malloc(width * sizeof(int));
+	for (int x = 0; x < width; x++) {
+		double oldX = (((double)x / width - 0.5) * scaleReal + offsetReal + 0.5) * width;
+		sourceX[x] = (int)floor(oldX + 0.5);
+	}
+
+	for (int y = 0; y < height; y++) {
+		double oldY = (((double)y / height - 0.5) * scaleImag + offsetImag + 0.5) * height;
+		int sy = (int)floor(oldY + 0.5);
+		bool rowInside = sy >= 0 && sy < height;
+		for (int x = 0; x < width; x++) {
+			int sx = sourceX[x];
+			int index = x + y * width;
+			int source = sx + sy * width;
+
+			if (!rowInside || sx < 0 || sx >= width || oldState[source] == PIXEL_MISSING) {
+				colors[index] = 0;
+				state[index] = PIXEL_MISSING;
+				continue;
+			}
+
+			colors[index] = oldColors[source];
+			state[index] = identity ? oldState[source] : PIXEL_PREVIEW;
+		}
+	}
+	free(sourceX);
+
+	//kept orbits belong to the old pixels, every tile is rendered again anyway
+	if (!identity) {
+		ClearOrbits(screen);
+		screen->antialiased = false;
+	}
+	screen->view = *viewport;
+
+	//every tile that is not exact yet gets queued, the ones with missing pixels first
+	int tileCount = TileCount(width, height, TILE_SIZE);
+	int missing = 0, preview = 0;
+	for (int pass = 0; pass < 2; pass++) {
+		for (int i = 0; i < tileCount; i++) {
+			Tile tile = TileGet(i, width, height, TILE_SIZE);
+			PixelState worst = PIXEL_EXACT;
+			for (int y = tile.y0; y < tile.y1 && worst != PIXEL_MISSING; y++) {
+				for (int x = tile.x0; x < tile.x1; x++) {
+					if (state[x + y * width] < worst)
+						worst = (PixelState)state[x + y * width];
+				}
+			}
+			if (pass == 0 && worst == PIXEL_MISSING)
+				screen->pending[missing++] = i;
+			else if (pass == 1 && worst == PIXEL_PREVIEW)
+				screen->pending[missing + preview++] = i;
+		}
+	}
+	screen->pendingCount = missing + preview;
+	screen->pendingMissing = missing;
+	screen->pendingNext = 0;
+	screen->revision += 1;
+}
+
+static void MarkTilesExact(Screen* screen, const int* tiles, int count) {
+	for (int i = 0; i < count; i++) {
+		Tile tile = TileGet(tiles[i], screen->width, screen->height, TILE_SIZE);
+		for (int y = tile.y0; y < tile.y1; y++) {
+			memset(screen->state + y * screen->width + tile.x0, PIXEL_EXACT, tile.x1 - tile.x0);
+		}
+	}
+}
+
+bool ScreenRefine(Screen* screen, double budget) {
+	double begin = TimeNow();
+	//a batch is a few tiles per worker so stealing still has something to balance
+	int batch = PoolWorkerCount() * 4;
+
+	while (screen->pendingNext < screen->pendingCount) {
+		const int* tiles = screen->pending + screen->pendingNext;
+
+		//tiles with missing pixels are never left for later and go out in one run
+		bool missing = screen->pendingNext < screen->pendingMissing;
+		int count = missing ? screen->pendingMissing - screen->pendingNext : minimum(batch, screen->pendingCount - screen->pendingNext);
+		if (!missing && TimeNow() - begin > budget)
+			break;
+
+		bool finished = RenderTiles(&screen->view, screen->width, screen->height, screen->colors, tiles, count, screen->orbits, screen->cancel);
+		screen->antialiased = false;
+		screen->revision += 1;
+		//skipped tiles cannot be told from rendered ones, the whole batch stays pending
+		if (!finished)
+			return false;
+		MarkTilesExact(screen, tiles, count);
+		screen->pendingNext += count;
+	}
+
+	//edges run across tiles, they are only looked for once the whole frame is exact
+	if (screen->pendingNext >= screen->pendingCount && AntialiasEnabled() && !screen->antialiased) {
+		bool finished = AntialiasFrame(&screen->view, screen->width, screen->height, screen->colors, &screen->samples, screen->cancel);
+		screen->revision += 1;
+		//a partly antialiased frame is a fine preview, the next run samples its edges again
+		if (!finished)
+			return false;
+		screen->antialiased = true;
+	}
+
+	return ScreenIsExact(screen);
+}
+
+bool ScreenIsExact(const Screen* screen) {
+	return screen->pendingNext >= screen->pendingCount && (screen->antialiased || !AntialiasEnabled());
+}
+
+void ScreenUpdateIterations(Screen* screen) {
+	if (maxIter == screen->maxIterations)
+		return;
+	//distance estimation keeps no orbits to continue
+	if (maxIter < screen->maxIterations || renderMode == RENDER_DISTANCE) {
+		ScreenRender(screen, &screen->view);
+		return;
+	}
+
+	//shades are relative to the limit, pixels at the limit are resumed below
+	const int count = screen->width * screen->height;
+	const uint64_t previous = screen->maxIterations;
+	for (int i = 0; i < count; i++) {
+		if (screen->colors[i] < SHADE_INTERIOR)
+			screen->colors[i] = (Shade)((screen->colors[i] * previous + maxIter / 2) / maxIter);
+	}
+
+	//subdivision is cheaper than continuing every pixel of a mostly unresolved tile one by one
+	int tileCount = TileCount(screen->width, screen->height, TILE_SIZE);
+	int* tiles = (int*)malloc(tileCount * sizeof(int));
+	int resumed = 0, rendered = 0;
+	for (int i = 0; i < tileCount; i++) {
+		if (renderMode == RENDER_SUBDIVIDE && screen->orbits[i].count > TILE_SIZE * TILE_SIZE / 2)
+			tiles[tileCount - 1 - rendered++] = i;
+		else if (screen->orbits[i].count)
+			tiles[resumed++] = i;
+	}
+	bool finished = ResumeTiles(&screen->view, screen->width, screen->height, screen->colors, tiles, resumed, screen->orbits, screen->cancel);
+	RenderStats stats = renderStats;
+	if (rendered && finished) {
+		finished = RenderTiles(&screen->view, screen->width, screen->height, screen->colors, tiles + tileCount - rendered, rendered, screen->orbits, screen->cancel);
+		RenderStatsAdd(&stats, &renderStats);
+	}
+	renderStats = stats;
+	free(tiles);
+
+	screen->maxIterations = maxIter;
+	screen->antialiased = false;
+	screen->revision += 1;
+
+	//some tiles reached the new limit and some did not, the rescaled colors serve as preview
+	if (!finished) {
+		ClearOrbits(screen);
+		DemoteExact(screen);
+		QueueAllTiles(screen, 0);
+	}
+}
+
+
+bool ParseInt(const char* text, int minimumValue, int* result) {
+	char* end;
+	long value = strtol(text, &end, 10);
+	if (end == text || *end || value < minimumValue || value > 1 << 30)
+		return false;
+	*result = (int)value;
+	return true;
+}
+
+bool ParseDouble(const char* text, double* result) {
+	char* end;
+	*result = strtod(text, &end);
+	return end != text && !*end;
+}
+
+bool ParsePalette(char* texts[3], float weights[3]) {
+	double values[3];
+	float parsed[3];
+	for (int i = 0; i < 3; i++) {
+		//the same range as PaletteWeightsValid, checked before a double beyond float is converted
+		if (!ParseDouble(texts[i], &values[i]) || !(values[i] >= 0.0 && values[i] <= PALETTE_MAX_WEIGHT))
+			return false;
+		parsed[i] = (float)values[i];
+	}
+	memcpy(weights, parsed, sizeof(parsed));
+	return true;
+}
@@ -0,0 +1,598 @@
+#ifndef MANDELBROT_H
+#define MANDELBROT_H
+
+#include "threads.h"
+
+
+//maximum amount of iteration, more the iteration higher the quality but slower (100 by default)
+extern int maxIter;
+
+#define minimum(a, b)			(((a) < (b)) ? (a) : (b))
+
+
+typedef enum bool{
+	false,true
+}bool;
+
+
+//complex number
+typedef struct Complex {
+	float real;
+	float imag;
+}Complex;
+
+
+/*
+	Fixed point numbers for deep zooms
+
+	A float runs out of bits once the view is about 1e-6 wide. The view center is kept
+	as a two's complement fixed point number instead: the top limb is the signed integer
+	part and the rest are fractional limbs, 7 x 32 bits give roughly 67 decimal digits.
+*/
+#define FIXED_LIMBS 8
+
+typedef struct Fixed {
+	uint32_t limb[FIXED_LIMBS];		//least significant first
+}Fixed;
+
+Fixed FixedFromDouble(double x);
+double FixedToDouble(Fixed x);
+Fixed FixedAdd(Fixed a, Fixed b);
+Fixed FixedSub(Fixed a, Fixed b);
+Fixed FixedMul(Fixed a, Fixed b);
+//exact decimal parsing ("-0.743643887037158704752191506114774"), exponents go through double,
+//returns false when text is not a number
+bool FixedParse(const char* text, Fixed* result);
+
+
+//visible region of the complex plane
+typedef struct Viewport {
+	Fixed centerReal, centerImag;
+	double spanReal, spanImag;		//width and height of the region
+}Viewport;
+
+extern Viewport view;
+
+void ViewportInit(Viewport* viewport, double startReal, double startImag, double endReal, double endImag);
+Complex ViewportStart(const Viewport* viewport);	//corners in float precision, as used by the shallow kernels
+Complex ViewportEnd(const Viewport* viewport);
+//zooms by factor around the point at (x, y) given as fractions of the width and height
+void ViewportZoom(Viewport* viewport, double x, double y, double factor);
+//true once float pixel coordinates can no longer resolve the view at this width
+bool ViewportIsDeep(const Viewport* viewport, int width);
+
+
+Complex initComplex(float real, float imag);
+Complex add(Complex c1, Complex c2);
+Complex multiply(Complex c1, Complex c2);
+float absolute(Complex c);
+
+int doesDiverge(Complex* c, float radius);
+
+
+/*
+	Escape-time kernels
+
+	A kernel iterates z = z^2 + c for count pixels at once. z and iterations are in/out:
+	callers start them at 0, and a pixel stops once |z| > radius or maxIterations is hit,
+	leaving the first escaped z behind for smooth coloring. The scalar kernel is the
+	reference built on doesDiverge's helpers, the vector ones run 4/8/16 pixels per
+	instruction with a per-lane escape mask and compare squared magnitudes instead of
+	calling sqrt every iteration.
+
+	With periodicity set, z is also compared against a checkpoint that is moved forward at
+	power of two steps (Brent). An orbit that comes back to its checkpoint has fallen into
+	an attracting cycle and will never escape, it is finished right away with the count
+	maxIterations + 1 to tell it from pixels that merely ran out of iterations. The kernel
+	returns how many pixels were finished that way.
+*/
+typedef int (*EscapeKernel)(const float* cReal, const float* cImag, float* zReal, float* zImag, int* iterations, int count, int maxIterations, float radius, bool periodicity);
+
+//orbits closer than this (squared) to their checkpoint count as periodic
+#define PERIODICITY_EPSILON 1e-12f
+
+typedef enum KernelType {
+	KERNEL_SCALAR, KERNEL_SSE2, KERNEL_AVX2, KERNEL_AVX512, KERNEL_COUNT
+}KernelType;
+
+const char* KernelName(KernelType type);
+bool KernelSupported(KernelType type);		//compiled in and supported by this cpu
+EscapeKernel GetKernel(KernelType type);	//NULL when not supported
+KernelType BestKernel(void);				//widest supported instruction set
+
+//the same kernel for z = z^exponent + c, exponents 2 to MAX_EXPONENT
+#define MAX_EXPONENT 8
+EscapeKernel GetPowerKernel(KernelType type, int exponent);
+
+//kernel used by MandelbrotSet, picked with BestKernel on first use
+extern KernelType activeKernel;
+
+
+/*
+	Fractal families
+
+	Besides the Mandelbrot set the float path renders Multibrot sets, z = z^n + c with an
+	integer exponent n, and Julia sets of the same formulas, where c is a fixed parameter
+	and z starts at the pixel. Every exponent has kernels of its own with n built in, Julia
+	sets only change the start values. The interior tests and perturbation only exist for
+	the quadratic Mandelbrot set, deep views of the other fractals stay on floats and run
+	out of precision instead. Subdivision assumes a connected set, disconnected Julia sets
+	(c outside the Mandelbrot set) can lose details to it.
+*/
+typedef enum FractalFamily {
+	FRACTAL_MANDELBROT, FRACTAL_JULIA, FRACTAL_FAMILY_COUNT
+}FractalFamily;
+
+typedef struct Fractal {
+	FractalFamily family;
+	int exponent;					//2 to MAX_EXPONENT
+	double juliaReal, juliaImag;	//c of the Julia set
+}Fractal;
+
+extern Fractal fractal;
+
+const char* FractalName(const Fractal* f);
+//the quadratic Mandelbrot set, the only one with interior tests and perturbation
+bool FractalIsMandelbrot(const Fractal* f);
+
+
+/*
+	Interior shortcuts
+
+	Interior points always cost the full iteration budget. Points inside the main cardioid
+	or the period 2 bulb are recognized analytically before iterating, the rest of the
+	interior is caught by the periodicity check in the kernels. Interior pixels all get the
+	smooth value of maxIter, their last z carries no information.
+*/
+extern bool interiorShortcuts;
+
+bool InMainCardioid(double real, double imag);
+bool InPeriod2Bulb(double real, double imag);
+
+
+/*
+	Shades
+
+	A pixel is stored as its smooth value, the escape time relative to maxIter scaled to
+	0..255, in 8.8 fixed point: the high byte is the palette band and the low byte the
+	fraction towards the next one. Two bytes are finer than any 8 bit channel the weights
+	can produce. Interior pixels get SHADE_INTERIOR. Colors only come in through a palette
+	that covers every shade, so changing the weights never touches the escape-time data.
+*/
+typedef uint16_t Shade;
+
+#define SHADE_ONE 256
+#define SHADE_INTERIOR (255 * SHADE_ONE)
+#define SHADE_LEVELS 65536
+
+Shade ShadeFromValue(float value);		//clamped to 0..255
+
+typedef struct Palette {
+	float weights[3];
+	uint8_t* entries;		//rgba per shade
+}Palette;
+
+//rebuilds the entries when the weights changed (or were never set), returns whether it did;
+//every channel is the smooth value times its weight clamped to 255
+bool PaletteUpdate(Palette* palette, const float weights[3]);
+//weights have to be finite, not negative and at most PALETTE_MAX_WEIGHT, anything else would
+//not fit the 8 bit channels
+#define PALETTE_MAX_WEIGHT 1e6f
+bool PaletteWeightsValid(const float weights[3]);
+void PaletteFree(Palette* palette);
+
+
+/*
+	Histogram equalization
+
+	With a high maxIter most pixels escape within a small fraction of the limit, their smooth
+	values crowd at the dark end and the frame washes out. Equalized coloring gives every
+	exterior shade the fraction of exterior pixels at or below it instead, so the palette is
+	spread evenly over the pixels of the frame at any iteration limit. The distribution is
+	two passes over the pool: every worker counts the rows it gets into a histogram of its
+	own, then every item adds up one range of shades over the workers and sums it, a scan
+	over the range sums gives each range its offset and a last pass adds the offsets. The
+	distribution is folded into the palette, so coloring stays the same lookup.
+*/
+#define HISTOGRAM_RANGES 64		//shade ranges merged as one item
+
+typedef struct Histogram {
+	uint32_t* counts;			//SHADE_LEVELS per worker, zero between frames
+	uint32_t* cumulative;		//exterior pixels at or below every shade
+	uint32_t rangeSums[HISTOGRAM_RANGES];
+	uint32_t total;				//exterior pixels
+	int workers;
+}Histogram;
+
+//counts the shades of a frame on the worker pool and rebuilds the cumulative distribution
+void HistogramCount(Histogram* histogram, const Shade* colors, int width, int height);
+void HistogramFree(Histogram* histogram);
+//rebuilds the entries with the weights spread over the distribution: an exterior shade gets
+//the value of its cumulative fraction, up to where the strongest channel saturates. Its
+//entries no longer match the weights PaletteUpdate compares, keep a palette for each
+void PaletteEqualize(Palette* palette, const float weights[3], const uint32_t* cumulative);
+
+
+//counters of one render, every worker keeps its own and they are summed afterwards
+typedef struct RenderStats {
+	long long computed;		//pixels iterated
+	long long filled;		//pixels filled by subdivision from a uniform border
+	long long mismatched;	//filled pixels whose count differs from brute force, only with verifySubdivision
+	long long cardioid;		//pixels resolved by the main cardioid test
+	long long bulb;			//pixels resolved by the period 2 bulb test
+	long long periodic;		//pixels resolved by periodicity detection
+	long long rebases;		//perturbation rebases
+	long long supersampled;	//edge pixels sampled again by antialiasing
+}RenderStats;
+
+extern RenderStats renderStats;	//of the last RenderTiles call
+
+void RenderStatsAdd(RenderStats* total, const RenderStats* stats);
+
+
+/*
+	Perturbation
+
+	Deep views are rendered relative to one reference orbit Z at the view center, computed
+	with Fixed numbers. Every pixel then only iterates its double precision offset dz from
+	that orbit, dz' = 2 Z dz + dz^2 + dc, so deep zooms cost about as much as shallow ones.
+	When |Z + dz| drops below |dz| the offset no longer describes the pixel well (a glitch),
+	or the reference orbit escaped before the pixel did; in both cases the pixel is rebased
+	onto the start of the reference orbit with dz = Z + dz and keeps going.
+*/
+typedef struct PerturbationStats {
+	int referenceLength;
+}PerturbationStats;
+
+extern PerturbationStats perturbationStats;
+
+
+/*
+	Resumable orbits
+
+	A pixel that reaches maxIter without being proven interior can be continued later from
+	its last z and iteration count (dz and the position in the reference orbit on the
+	perturbation path), so raising maxIter only costs the extra iterations of those pixels.
+	Pixels proven interior by the shortcuts are marked and never continued.
+*/
+#define ORBIT_INTERIOR -1
+
+typedef struct PixelOrbit {
+	int index;				//x + y * width, kept by the owner of the orbit
+	int iterations;
+	int reference;			//position in the reference orbit, or ORBIT_INTERIOR
+	double zReal, zImag;	//z on the float path, dz on the perturbation path
+}PixelOrbit;
+
+//orbits of the unresolved pixels of one tile
+typedef struct TileOrbits {
+	PixelOrbit* items;
+	int count, capacity;
+}TileOrbits;
+
+void TileOrbitsAppend(TileOrbits* orbits, const PixelOrbit* orbit);
+
+
+//state shared by every tile of one render
+typedef struct RenderContext RenderContext;
+
+//computes iteration counts and shades for count pixels given by their coordinates, orbits
+//(NULL to start every pixel at z = 0) gives the state each pixel continues from and receives the final one
+typedef void (*PixelProc)(RenderContext* context, const int* xs, const int* ys, int count, PixelOrbit* orbits, int* iterations, Shade* colors, RenderStats* stats);
+
+struct RenderContext {
+	int width, height;
+	float radius;
+	bool shortcuts;
+	bool distance;			//color by estimated distance instead of escape time
+	PixelProc pixels;
+
+	//the viewport in double precision
+	double centerReal, centerImag;
+	double spanReal, spanImag;
+	double pixelWidth;		//of a frame pixel, width may count finer sample positions
+
+	//float path
+	Complex start, end;
+	EscapeKernel kernel;
+	bool interiorTests;		//cardioid and bulb, only for the Mandelbrot set
+	bool julia;				//z starts at the pixel, c is juliaC
+	Complex juliaC;
+	int exponent;
+
+	//perturbation path
+	const double* refReal;
+	const double* refImag;
+	int refLength;
+};
+
+//computes (or reuses) the reference orbit of viewport and points context at the perturbation pixels
+void PerturbationBegin(RenderContext* context, const Viewport* viewport);
+void PerturbationEnd(RenderContext* context);
+
+
+/*
+	Render modes
+
+	Brute force iterates every pixel. Subdivision (Mariani-Silver) iterates the border of a
+	tile and fills the inside when the whole border has the same iteration count, otherwise
+	the rectangle is split in two and both halves are handled the same way. The set is
+	connected, so a uniform border cannot hide a different region inside; large interior
+	areas and exterior bands are filled without iterating them. Filled pixels get the smooth
+	value interpolated from the border. With verifySubdivision every filled pixel is also
+	iterated and compared, mismatches are counted in renderStats.
+
+	Distance estimation iterates every pixel together with the derivative dz of its orbit
+	and colors escaped pixels by their estimated distance to the set, 0.5 |z| log|z| / |dz|,
+	in pixels. Filaments much thinner than a pixel still show up as bright lines no matter
+	how late they escape, so a low maxIter is enough for a sharp boundary. The loop runs in
+	double without the vector kernels, its orbits are not kept for resuming.
+*/
+typedef enum RenderMode {
+	RENDER_BRUTE_FORCE, RENDER_SUBDIVIDE, RENDER_DISTANCE, RENDER_MODE_COUNT
+}RenderMode;
+
+extern RenderMode renderMode;
+extern bool verifySubdivision;
+
+const char* RenderModeName(RenderMode mode);
+//orbits (may be NULL) receives the pixels of the tile that stopped at maxIter unresolved
+void SubdivideTile(RenderContext* context, Tile tile, Shade* colors, RenderStats* stats, TileOrbits* orbits);
+
+//a larger escape radius makes the distance estimate more accurate
+#define DISTANCE_RADIUS 1000.0f
+#define DISTANCE_BRIGHTNESS 64.0	//value of a pixel on the boundary, falls off with the square root of the distance
+
+//float path pixels of distance estimation
+void DistancePixels(RenderContext* context, const int* xs, const int* ys, int count, PixelOrbit* orbits, int* iterations, Shade* colors, RenderStats* stats);
+//shade of an escaped pixel with |z| magnitude and |dz| derivative, pixel is the pixel width
+Shade DistanceShade(double magnitude, double derivative, double pixel);
+
+
+/*
+	Adaptive antialiasing
+
+	Supersampling every pixel multiplies the render time, yet most pixels sit in smooth
+	bands where more samples change nothing. After a frame is rendered at one sample per
+	pixel, pixels whose smooth value differs from one of their eight neighbours by more than
+	the threshold (interior next to exterior always does) are marked as edges, and only
+	those are sampled again. The samples are spread over the pixel by a pattern: a regular
+	grid, a grid jittered per pixel or a Halton sequence. Grid patterns use the largest
+	square count up to samples. Jitter is derived from the pixel position, so the same view
+	always gets the same samples.
+
+	The mean of the sample shades is not the mean of their colors: channels saturate, an
+	equalized palette is a step function of the shade and interior sits at the far end of
+	the shade range. So the samples of every edge pixel are kept next to the frame and the
+	pixel is colored with the mean of their palette entries, whatever the palette is at the
+	time. The shade stored in the frame, which edges, histograms and reprojected previews
+	still see, is the mean of the exterior samples, or interior when most samples are.
+*/
+typedef enum SamplePattern {
+	SAMPLE_GRID, SAMPLE_JITTERED, SAMPLE_HALTON, SAMPLE_PATTERN_COUNT
+}SamplePattern;
+
+typedef struct Antialias {
+	int samples;			//per edge pixel, 1 or less turns antialiasing off
+	float threshold;		//smooth value difference that makes an edge
+	SamplePattern pattern;
+}Antialias;
+
+extern Antialias antialias;
+
+//sample positions are quantized to this many steps per pixel
+#define ANTIALIAS_SUBPIXELS 64
+
+//the samples of the supersampled pixels of a frame, grouped by tile
+typedef struct EdgeSamples {
+	int* pixels;			//index of every supersampled pixel
+	Shade* shades;			//samples per pixel, one run after the other
+	int* tileStarts;		//where the pixels of every tile begin, tiles + 1 entries
+	int count, samples, tiles;
+	int capacity, shadeCapacity, tileCapacity;
+}EdgeSamples;
+
+const char* SamplePatternName(SamplePattern pattern);
+bool AntialiasEnabled(void);
+//collects the edge pixels of every tile into edges (one list per tile index, pixel index only)
+void FindEdges(const Shade* colors, int width, int height, TileOrbits* edges);
+//lists the edges of every tile in samples and makes room for their samples
+void EdgeSamplesPrepare(EdgeSamples* samples, const TileOrbits* edges, int tileCount);
+//samples the listed pixels into shades (samples.samples per pixel) and stores their representative shade
+void SupersampleTile(RenderContext* context, const TileOrbits* edges, Shade* colors, Shade* shades, RenderStats* stats);
+//replaces the pixels of supersampled pixels, colored from the frame with palette, by the mean color of their samples
+void ColorizeSamples(const EdgeSamples* samples, const Palette* palette, uint8_t* pixels, int channels);
+void EdgeSamplesCopy(EdgeSamples* to, const EdgeSamples* from);
+void EdgeSamplesFree(EdgeSamples* samples);
+
+
+//lets another thread abandon a render: tiles that have not started yet are skipped once
+//*generation no longer equals expected, tiles already running are finished
+typedef struct RenderCancel {
+	volatile int32_t* generation;
+	int32_t expected;
+}RenderCancel;
+
+//renders the listed TILE_SIZE tiles (every tile when tiles is NULL) of a width x height frame
+//on the worker pool, switching to perturbation once the view is too deep for floats. With
+//orbits (one list per tile index) the lists of the rendered tiles are rebuilt. cancel may
+//be NULL, returns false when tiles were skipped.
+bool RenderTiles(const Viewport* viewport, int width, int height, Shade* colors, const int* tiles, int tileCount, TileOrbits* orbits, const RenderCancel* cancel);
+
+//continues the unresolved orbits of the listed tiles up to the current maxIter, resolved
+//pixels get their color and leave the lists. Skipped tiles keep their lists untouched.
+bool ResumeTiles(const Viewport* viewport, int width, int height, Shade* colors, const int* tiles, int tileCount, TileOrbits* orbits, const RenderCancel* cancel);
+
+//renders only the listed pixels (one list per tile index, pixel index only) pixel by pixel in
+//any render mode, the other pixels keep their colors
+bool RenderPixels(const Viewport* viewport, int width, int height, Shade* colors, TileOrbits* pixels, const RenderCancel* cancel);
+
+//supersamples the edge pixels of a rendered frame into samples, see Adaptive antialiasing. Adds
+//its counts to renderStats, returns false when tiles were skipped; samples is empty then.
+bool AntialiasFrame(const Viewport* viewport, int width, int height, Shade* colors, EdgeSamples* samples, const RenderCancel* cancel);
+
+//renders the whole frame of view
+void MandelbrotSet(int width, int height, Shade* colors);
+
+//looks shades up in palette and writes 8 bit pixels with channels 3 (rgb) or 4 (rgba, opaque)
+//bytes each, spread over the worker pool
+void ColorizeFrame(const Shade* colors, int width, int height, const Palette* palette, uint8_t* pixels, int channels);
+//the same for count pixels on the calling thread
+void ColorizePixels(const Shade* colors, int count, const Palette* palette, uint8_t* pixels, int channels);
+
+
+//command line arguments of the subcommands: the whole text has to be the number, integers
+//go up to 2^30
+bool ParseInt(const char* text, int minimumValue, int* result);
+bool ParseDouble(const char* text, double* result);
+//three arguments R G B, weights is only written when all of them are valid palette weights
+bool ParsePalette(char* texts[3], float weights[3]);
+
+
+/*
+	Poster rendering
+
+	Renders a viewport without a window in bands of rows and streams the rows into a PNG or
+	PPM file while the next band renders, memory stays a few bands no matter the image size.
+	Called with the arguments after "poster" on the command line, returns the exit code.
+*/
+int PosterMain(int argc, char* argv[]);
+
+//orbit density (Buddhabrot) of random escaping orbits, written as a 16 bit image; "buddhabrot"
+//on the command line
+int BuddhabrotMain(int argc, char* argv[]);
+
+//serves z/x/y map tiles over HTTP on localhost from a memory and disk tile cache, "serve" on
+//the command line; runs until the process is killed
+int ServerMain(int argc, char* argv[]);
+
+//zoom animation along a keyframe path, streamed as Y4M video to a file or stdout; "zoom" on
+//the command line
+int ZoomMain(int argc, char* argv[]);
+
+//runs every supported kernel over fixed viewports, sizes and iteration limits and prints
+//Mpix/s, iterations/s and a checksum of the iteration counts; "benchmark" on the command line
+int BenchmarkMain(int argc, char* argv[]);
+
+
+/*
+	Incremental rendering
+
+	The screen keeps the viewport its pixels belong to and a state per pixel. A pan or zoom
+	first reprojects the previous pixels into the new viewport as a preview, pixels that
+	land outside the previous frame are missing. Missing tiles are rendered straight away,
+	preview tiles are refined afterwards a few at a time, so the latency of a zoom step
+	follows the newly exposed area instead of the whole frame.
+*/
+typedef enum PixelState {
+	PIXEL_MISSING, PIXEL_PREVIEW, PIXEL_EXACT
+}PixelState;
+
+//screen parameters
+typedef struct Screen {
+	Shade* colors;
+	int width, height;
+
+	Viewport view;			//viewport the pixels belong to
+	uint8_t* state;			//PixelState per pixel
+
+	Shade* scratchColors;	//reprojection source
+	uint8_t* scratchState;
+	int* pending;			//tiles still waiting for refinement, in render order
+	int pendingCount;
+	int pendingMissing;		//the first pendingMissing tiles contain missing pixels
+	int pendingNext;
+
+	int capacity;			//pixels the per pixel buffers hold
+
+	int maxIterations;		//maxIter the colors were computed with
+	TileOrbits* orbits;		//unresolved pixels of every exact tile
+	int tileCount;			//orbit lists and pending entries allocated, at least the tiles of the frame
+
+	bool antialiased;		//the edges of the exact frame are supersampled
+	EdgeSamples samples;	//their samples, only valid while antialiased
+
+	unsigned revision;		//changes whenever colors change
+	const RenderCancel* cancel;	//NULL unless renders may be abandoned
+}Screen;
+
+//every pixel becomes missing, missing pixels are black. Buffers only grow, geometrically.
+void ScreenResize(Screen* screen, int width, int height);
+//full render, every pixel exact. A cancelled render leaves the remaining tiles pending with
+//the previous pixels as preview.
+void ScreenRender(Screen* screen, const Viewport* viewport);
+void ScreenReproject(Screen* screen, const Viewport* viewport);
+//renders missing tiles, then refines preview tiles until budget seconds are used up and
+//antialiases the frame once every tile is exact, returns true once the whole screen is exact
+bool ScreenRefine(Screen* screen, double budget);
+bool ScreenIsExact(const Screen* screen);
+//switches to the current maxIter: a higher limit continues the unresolved pixels of the exact
+//tiles from where they stopped, a lower one renders the frame again
+void ScreenUpdateIterations(Screen* screen);
+
+
+/*
+	Background rendering
+
+	The window does not render by itself. It posts requests (viewport, size and settings)
+	to a render thread that owns the screen, and every request bumps a generation counter
+	the tiles are checked against. A burst of scroll events therefore only waits for the
+	tiles already running before the newest viewport is rendered. After every step the
+	thread publishes a copy of the shades and of the edge samples; the window keeps drawing
+	the last published frame, whether it is complete or still being refined. With equalized
+	coloring the thread also counts the histogram of every frame it publishes on the pool
+	and publishes the distribution with it.
+
+	While a window edge is being dragged the window sends preview requests, which render at
+	a quarter of the size and are stretched to the window; the full size is only requested
+	once the size has settled for a moment.
+*/
+typedef struct RenderRequest {
+	Viewport view;
+	int width, height;
+	int maxIterations;
+	RenderMode mode;
+	bool verify, shortcuts;
+	Fractal fractal;
+	Antialias antialias;
+	bool preview;			//the size is still changing, render at 1 / RESIZE_PREVIEW_SCALE of it
+	bool equalize;			//publish the distribution of the shades for equalized coloring
+}RenderRequest;
+
+#define RESIZE_PREVIEW_SCALE 4
+
+typedef struct Renderer {
+	Thread thread;
+	Mutex lock;
+	Condition wake;
+	volatile int32_t generation;	//bumped by every request
+	RenderRequest request;			//newest request, under lock
+	bool quit;
+
+	Screen screen;					//owned by the render thread
+	Histogram histogram;
+
+	//last published frame, under frameLock
+	Mutex frameLock;
+	Shade* frame;
+	int frameWidth, frameHeight;
+	int frameCapacity;
+	unsigned frameRevision;
+	uint32_t* frameCumulative;		//distribution of the frame, SHADE_LEVELS entries
+	bool frameEqualized;			//frameCumulative belongs to the frame
+	EdgeSamples frameSamples;		//samples of the supersampled pixels of the frame
+}Renderer;
+
+bool RendererStart(Renderer* renderer, const RenderRequest* request);
+void RendererStop(Renderer* renderer);
+//replaces the pending request and abandons the work on older ones
+void RendererPost(Renderer* renderer, const RenderRequest* request);
+//locks the last published frame, NULL until the first one is there
+const Shade* RendererLockFrame(Renderer* renderer, int* width, int* height, unsigned* revision);
+void RendererUnlockFrame(Renderer* renderer);
+//cumulative distribution of the locked frame, NULL unless it was rendered for equalized coloring
+const uint32_t* RendererFrameHistogram(Renderer* renderer);
+//samples of the supersampled pixels of the locked frame, empty unless it is antialiased
+const EdgeSamples* RendererFrameSamples(Renderer* renderer);
+
+#endif
@@ -0,0 +1,303 @@
+#include "mandelbrot.h"
+#include "image.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+	Headless poster renderer
+
+	The image is cut into bands of rows, every band is rendered as its own viewport on the
+	worker pool and colored into one of two row buffers. A writer thread encodes the
+	previous band while the next one renders, so the pool is only idle when the encoder
+	falls behind. Rendering goes through the usual path, deep viewports switch to
+	perturbation on their own.
+
+	Equalized colors need the distribution of the whole image before the first band is
+	colored. The poster is never in memory at once, so a render of the whole view at most
+	EQUALIZE_PREVIEW pixels wide stands in for it; the distribution hardly changes with size.
+*/
+
+#define EQUALIZE_PREVIEW 1024
+
+typedef struct PosterOutput {
+	ImageWriter* image;
+	int width;
+
+	Mutex lock;
+	Condition changed;
+	uint8_t* rows[2];		//rgb rows of a band, bottom row first
+	int rowCount[2];
+	bool full[2];
+	bool finished;			//no more bands are coming
+	bool failed;
+}PosterOutput;
+
+static void WriteBands(void* data) {
+	PosterOutput* output = (PosterOutput*)data;
+	const size_t stride = (size_t)output->width * 3;
+
+	for (int slot = 0;; slot ^= 1) {
+		MutexLock(&output->lock);
+		while (!output->full[slot] && !output->finished) {
+			ConditionWait(&output->changed, &output->lock);
+		}
+		if (!output->full[slot]) {
+			MutexUnlock(&output->lock);
+			return;
+		}
+		int rows = output->rowCount[slot];
+		MutexUnlock(&output->lock);
+
+		//the file starts with the top row
+		bool failed = false;
+		for (int y = rows - 1; y >= 0 && !failed; y--) {
+			failed = !ImageWriteRows(output->image, output->rows[slot] + y * stride, 1);
+		}
+
+		MutexLock(&output->lock);
+		output->full[slot] = false;
+		if (failed)
+			output->failed = true;
+		ConditionBroadcast(&output->changed);
+		MutexUnlock(&output->lock);
+	}
+}
+
+
+static void PrintUsage(void) {
+	fprintf(stderr,
+		"usage: mandelbrot poster [options] output.png|output.ppm\n"
+		"  --size WIDTH HEIGHT      image size in pixels (default 4096 4096)\n"
+		"  --center REAL IMAG       view center, as many digits as needed (default -0.75 0)\n"
+		"  --span WIDTH             view width in the complex plane, the height follows the aspect (default 4)\n"
+		"  --viewport X0 Y0 X1 Y1   view corners instead of --center and --span\n"
+		"  --iterations N           maximum iterations (default 100)\n"
+		"  --exponent N             z^N + c, 2 to 8 (default 2)\n"
+		"  --julia REAL IMAG        Julia set of the parameter instead of the Mandelbrot set\n"
+		"  --palette R G B          color weights as on the sliders (default 5 2 3)\n"
+		"  --band ROWS              rows rendered per band (default 256)\n"
+		"  --subdivide              render with subdivision instead of brute force\n"
+		"  --distance               color by estimated distance to the set\n"
+		"  --equalize               spread the colors evenly over the pixels (histogram equalization)\n"
+		"  --antialias N            supersample edge pixels with N samples each (default off)\n"
+		"  --pattern NAME           sample pattern: grid, jittered or halton (default jittered)\n"
+		"  --threshold VALUE        smooth value difference to a neighbour that makes an edge (default 1)\n");
+}
+
+int PosterMain(int argc, char* argv[]) {
+	int width = 4096, height = 4096, band = 256;
+	Viewport viewport;
+	double span = 4.0;
+	bool corners = false;
+	double x0 = 0, y0 = 0, x1 = 0, y1 = 0;
+	float weights[3] = { 5.0f, 2.0f, 3.0f };
+	const char* path = NULL;
+	bool equalize = false;
+
+	viewport.centerReal = FixedFromDouble(-0.75);
+	viewport.centerImag = FixedFromDouble(0.0);
+
+	for (int i = 0; i < argc; i++) {
+		const char* arg = argv[i];
+		int left = argc - i - 1;
+		bool ok = true;
+
+		if (strcmp(arg, "--size") == 0 && left >= 2) {
+			ok = ParseInt(argv[i + 1], 1, &width) && ParseInt(argv[i + 2], 1, &height);
+			i += 2;
+		}
+		else if (strcmp(arg, "--center") == 0 && left >= 2) {
+			ok = FixedParse(argv[i + 1], &viewport.centerReal) && FixedParse(argv[i + 2], &viewport.centerImag);
+			i += 2;
+		}
+		else if (strcmp(arg, "--span") == 0 && left >= 1) {
+			ok = ParseDouble(argv[i + 1], &span) && span > 0.0;
+			i += 1;
+		}
+		else if (strcmp(arg, "--viewport") == 0 && left >= 4) {
+			ok = ParseDouble(argv[i + 1], &x0) && ParseDouble(argv[i + 2], &y0) &&
+				ParseDouble(argv[i + 3], &x1) && ParseDouble(argv[i + 4], &y1) && x1 > x0 && y1 > y0;
+			corners = true;
+			i += 4;
+		}
+		else if (strcmp(arg, "--iterations") == 0 && left >= 1) {
+			ok = ParseInt(argv[i + 1], 1, &maxIter);
+			i += 1;
+		}
+		else if (strcmp(arg, "--exponent") == 0 && left >= 1) {
+			ok = ParseInt(argv[i + 1], 2, &fractal.exponent) && fractal.exponent <= MAX_EXPONENT;
+			i += 1;
+		}
+		else if (strcmp(arg, "--julia") == 0 && left >= 2) {
+			ok = ParseDouble(argv[i + 1], &fractal.juliaReal) && ParseDouble(argv[i + 2], &fractal.juliaImag);
+			fractal.family = FRACTAL_JULIA;
+			i += 2;
+		}
+		else if (strcmp(arg, "--palette") == 0 && left >= 3) {
+			ok = ParsePalette(argv + i + 1, weights);
+			i += 3;
+		}
+		else if (strcmp(arg, "--band") == 0 && left >= 1) {
+			ok = ParseInt(argv[i + 1], 1, &band);
+			i += 1;
+		}
+		else if (strcmp(arg, "--subdivide") == 0) {
+			renderMode = RENDER_SUBDIVIDE;
+		}
+		else if (strcmp(arg, "--distance") == 0) {
+			renderMode = RENDER_DISTANCE;
+		}
+		else if (strcmp(arg, "--equalize") == 0) {
+			equalize = true;
+		}
+		else if (strcmp(arg, "--antialias") == 0 && left >= 1) {
+			ok = ParseInt(argv[i + 1], 1, &antialias.samples);
+			i += 1;
+		}
+		else if (strcmp(arg, "--pattern") == 0 && left >= 1) {
+			int pattern = 0;
+			while (pattern < SAMPLE_PATTERN_COUNT && strcmp(argv[i + 1], SamplePatternName((SamplePattern)pattern)) != 0) {
+				pattern++;
+			}
+			ok = pattern < SAMPLE_PATTERN_COUNT;
+			antialias.pattern = (SamplePattern)pattern;
+			i += 1;
+		}
+		else if (strcmp(arg, "--threshold") == 0 && left >= 1) {
+			double threshold;
+			ok = ParseDouble(argv[i + 1], &threshold) && threshold >= 0.0;
+			antialias.threshold = (float)threshold;
+			i += 1;
+		}
+		else if (arg[0] != '-' && !path) {
+			path = arg;
+		}
+		else {
+			ok = false;
+		}
+
+		if (!ok) {
+			fprintf(stderr, "poster: bad argument %s\n", arg);
+			PrintUsage();
+			return 1;
+		}
+	}
+	if (!path) {
+		PrintUsage();
+		return 1;
+	}
+
+	if (corners) {
+		ViewportInit(&viewport, x0, y0, x1, y1);
+	}
+	else {
+		viewport.spanReal = span;
+		viewport.spanImag = span * height / width;
+	}
+	band = minimum(band, height);
+
+	PosterOutput output = { 0 };
+	output.image = ImageOpen(path, width, height);
+	if (!output.image) {
+		fprintf(stderr, "poster: cannot create %s\n", path);
+		return 1;
+	}
+	output.width = width;
+	MutexInit(&output.lock);
+	ConditionInit(&output.changed);
+	for (int i = 0; i < 2; i++) {
+		output.rows[i] = (uint8_t*)malloc((size_t)width * band * 3);
+	}
+	Shade* colors = (Shade*)malloc((size_t)width * band * sizeof(Shade));
+	EdgeSamples samples = { 0 };
+	Palette palette = { 0 };
+	PaletteUpdate(&palette, weights);
+	if (equalize) {
+		int side = width > height ? width : height;
+		int scale = (side + EQUALIZE_PREVIEW - 1) / EQUALIZE_PREVIEW;
+		int previewWidth = (width + scale - 1) / scale, previewHeight = (height + scale - 1) / scale;
+		Shade* preview = (Shade*)malloc((size_t)previewWidth * previewHeight * sizeof(Shade));
+		Histogram histogram = { 0 };
+		RenderTiles(&viewport, previewWidth, previewHeight, preview, NULL, 0, NULL, NULL);
+		HistogramCount(&histogram, preview, previewWidth, previewHeight);
+		PaletteEqualize(&palette, weights, histogram.cumulative);
+		HistogramFree(&histogram);
+		free(preview);
+	}
+
+	Thread writer;
+	bool failed = !ThreadStart(&writer, WriteBands, &output);
+	if (failed)
+		output.finished = true;
+
+	double begin = TimeNow();
+	int bands = (height + band - 1) / band;
+	long long supersampled = 0;
+
+	//image rows run top down, frame rows (and the imaginary axis) bottom up
+	for (int i = 0; i < bands && !failed; i++) {
+		int top = i * band;
+		int rows = minimum(band, height - top);
+		int frameY0 = height - top - rows;
+
+		Viewport part = viewport;
+		double middle = (frameY0 + rows * 0.5) / height - 0.5;
+		part.centerImag = FixedAdd(viewport.centerImag, FixedFromDouble(middle * viewport.spanImag));
+		part.spanImag = viewport.spanImag * rows / height;
+		RenderTiles(&part, width, rows, colors, NULL, 0, NULL, NULL);
+		//edges are looked for within the band
+		if (AntialiasEnabled()) {
+			AntialiasFrame(&part, width, rows, colors, &samples, NULL);
+			supersampled += renderStats.supersampled;
+		}
+
+		int slot = i & 1;
+		MutexLock(&output.lock);
+		while (output.full[slot] && !output.failed) {
+			ConditionWait(&output.changed, &output.lock);
+		}
+		failed = output.failed;
+		MutexUnlock(&output.lock);
+		if (failed)
+			break;
+
+		ColorizeFrame(colors, width, rows, &palette, output.rows[slot], 3);
+		if (AntialiasEnabled())
+			ColorizeSamples(&samples, &palette, output.rows[slot], 3);
+
+		MutexLock(&output.lock);
+		output.rowCount[slot] = rows;
+		output.full[slot] = true;
+		ConditionBroadcast(&output.changed);
+		MutexUnlock(&output.lock);
+
+		fprintf(stderr, "\rband %d/%d", i + 1, bands);
+	}
+
+	if (!output.finished) {
+		MutexLock(&output.lock);
+		output.finished = true;
+		ConditionBroadcast(&output.changed);
+		MutexUnlock(&output.lock);
+		ThreadJoin(writer);
+	}
+
+	failed = !ImageClose(output.image) || failed || output.failed;
+	double seconds = TimeNow() - begin;
+	fprintf(stderr, "\n%s: %d x %d, %d iterations, %.2f s (%.1f Mpix/s)%s\n", path, width, height, maxIter, seconds,
+		(double)width * height / seconds * 1e-6, failed ? ", write failed" : "");
+	if (AntialiasEnabled())
+		fprintf(stderr, "%lld edge pixels supersampled (%.1f%%), %d %s samples\n", supersampled,
+			100.0 * supersampled / ((double)width * height), antialias.samples, SamplePatternName(antialias.pattern));
+
+	free(colors);
+	EdgeSamplesFree(&samples);
+	PaletteFree(&palette);
+	free(output.rows[0]);
+	free(output.rows[1]);
+	ConditionDestroy(&output.changed);
+	MutexDestroy(&output.lock);
+	return failed ? 1 : 0;
+}
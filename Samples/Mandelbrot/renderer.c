@@ -0,0 +1,215 @@
+#include "mandelbrot.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+static void PrintStats(void) {
+	RenderStats stats = renderStats;
+	long long total = stats.computed + stats.filled;
+	printf("%s: %lld pixels iterated, %lld filled (%.1f%%)", RenderModeName(renderMode),
+		stats.computed, stats.filled, total ? 100.0 * stats.filled / total : 0.0);
+	if (verifySubdivision)
+		printf(", %lld filled pixels differ from brute force", stats.mismatched);
+	if (interiorShortcuts)
+		printf(", interior: %lld cardioid, %lld bulb, %lld periodic", stats.cardioid, stats.bulb, stats.periodic);
+	if (AntialiasEnabled())
+		printf(", %lld edge pixels supersampled (%d %s)", stats.supersampled, antialias.samples, SamplePatternName(antialias.pattern));
+	printf("\n");
+}
+
+static bool Cancelled(const RenderCancel* cancel) {
+	return AtomicLoad(cancel->generation) != cancel->expected;
+}
+
+//brings the screen from the applied request to the new one with as little work as possible
+static void ApplyRequest(Screen* screen, RenderRequest* applied, const RenderRequest* request) {
+	int scale = request->preview ? RESIZE_PREVIEW_SCALE : 1;
+	int width = (request->width + scale - 1) / scale, height = (request->height + scale - 1) / scale;
+	bool resized = width != screen->width || height != screen->height;
+	bool settings = request->mode != applied->mode || request->verify != applied->verify || request->shortcuts != applied->shortcuts ||
+		memcmp(&request->fractal, &applied->fractal, sizeof(Fractal)) != 0 || memcmp(&request->antialias, &applied->antialias, sizeof(Antialias)) != 0;
+	bool moved = memcmp(&request->view, &applied->view, sizeof(Viewport)) != 0;
+	bool iterations = request->maxIterations != applied->maxIterations;
+	bool recolored = request->equalize != applied->equalize;
+	double begin = TimeNow();
+
+	//the render code reads these, while the window is open only this thread writes them
+	renderMode = request->mode;
+	verifySubdivision = request->verify;
+	interiorShortcuts = request->shortcuts;
+	fractal = request->fractal;
+	antialias = request->antialias;
+	maxIter = request->maxIterations;
+	*applied = *request;
+	//the shades stay, the frame is only published again with or without its distribution
+	if (recolored)
+		screen->revision += 1;
+
+	if (resized) {
+		ScreenResize(screen, width, height);
+		ScreenRender(screen, &request->view);
+	}
+	else if (settings) {
+		ScreenRender(screen, &request->view);
+	}
+	else {
+		//the previous frame stays up as a preview, only newly exposed tiles are rendered now
+		if (moved)
+			ScreenReproject(screen, &request->view);
+		//raising continues the unresolved pixels instead of starting over
+		if (iterations)
+			ScreenUpdateIterations(screen);
+		ScreenRefine(screen, 0.0);
+	}
+
+	if (Cancelled(screen->cancel) || request->preview)
+		return;
+	if (settings)
+		PrintStats();
+	else if (iterations && !moved)
+		printf("%d iterations: %lld pixels iterated in %.3f s\n", maxIter, renderStats.computed, TimeNow() - begin);
+}
+
+static void Publish(Renderer* renderer, const Screen* screen, bool equalize) {
+	const size_t count = (size_t)screen->width * screen->height;
+	//counted on the pool before the lock, the window only waits for the copies
+	if (equalize)
+		HistogramCount(&renderer->histogram, screen->colors, screen->width, screen->height);
+
+	MutexLock(&renderer->frameLock);
+	if ((int)count > renderer->frameCapacity) {
+		renderer->frameCapacity = (int)count > renderer->frameCapacity * 3 / 2 ? (int)count : renderer->frameCapacity * 3 / 2;
+		renderer->frame = (Shade*)realloc(renderer->frame, renderer->frameCapacity * sizeof(Shade));
+	}
+	memcpy(renderer->frame, screen->colors, count * sizeof(Shade));
+	renderer->frameWidth = screen->width;
+	renderer->frameHeight = screen->height;
+	renderer->frameRevision += 1;
+	if (equalize) {
+		if (!renderer->frameCumulative)
+			renderer->frameCumulative = (uint32_t*)malloc(SHADE_LEVELS * sizeof(uint32_t));
+		memcpy(renderer->frameCumulative, renderer->histogram.cumulative, SHADE_LEVELS * sizeof(uint32_t));
+	}
+	renderer->frameEqualized = equalize;
+	//samples of an older antialiasing pass belong to other pixels
+	if (screen->antialiased)
+		EdgeSamplesCopy(&renderer->frameSamples, &screen->samples);
+	else
+		renderer->frameSamples.count = 0;
+	MutexUnlock(&renderer->frameLock);
+}
+
+static void RenderLoop(void* data) {
+	Renderer* renderer = (Renderer*)data;
+	Screen* screen = &renderer->screen;
+	RenderRequest applied = { 0 };
+	RenderCancel cancel;
+	int32_t handled = 0;
+	unsigned published = screen->revision;
+
+	cancel.generation = &renderer->generation;
+	screen->cancel = &cancel;
+
+	for (;;) {
+		MutexLock(&renderer->lock);
+		while (!renderer->quit && AtomicLoad(&renderer->generation) == handled && ScreenIsExact(screen)) {
+			ConditionWait(&renderer->wake, &renderer->lock);
+		}
+		if (renderer->quit) {
+			MutexUnlock(&renderer->lock);
+			return;
+		}
+		RenderRequest request = renderer->request;
+		cancel.expected = AtomicLoad(&renderer->generation);
+		MutexUnlock(&renderer->lock);
+
+		//a new request first, otherwise the preview is refined a little at a time
+		if (cancel.expected != handled) {
+			handled = cancel.expected;
+			ApplyRequest(screen, &applied, &request);
+		}
+		else {
+			ScreenRefine(screen, 0.012);
+		}
+
+		//abandoned steps are published too, their tiles are either old or new pixels
+		if (screen->revision != published) {
+			Publish(renderer, screen, applied.equalize);
+			published = screen->revision;
+		}
+	}
+}
+
+bool RendererStart(Renderer* renderer, const RenderRequest* request) {
+	memset(renderer, 0, sizeof(Renderer));
+	MutexInit(&renderer->lock);
+	MutexInit(&renderer->frameLock);
+	ConditionInit(&renderer->wake);
+	renderer->request = *request;
+	renderer->generation = 1;
+	if (ThreadStart(&renderer->thread, RenderLoop, renderer))
+		return true;
+
+	ConditionDestroy(&renderer->wake);
+	MutexDestroy(&renderer->frameLock);
+	MutexDestroy(&renderer->lock);
+	return false;
+}
+
+void RendererStop(Renderer* renderer) {
+	MutexLock(&renderer->lock);
+	renderer->quit = true;
+	AtomicAdd(&renderer->generation, 1);
+	ConditionBroadcast(&renderer->wake);
+	MutexUnlock(&renderer->lock);
+	ThreadJoin(renderer->thread);
+
+	Screen* screen = &renderer->screen;
+	for (int i = 0; i < screen->tileCount; i++) {
+		free(screen->orbits[i].items);
+	}
+	free(screen->orbits);
+	free(screen->colors);
+	free(screen->scratchColors);
+	free(screen->state);
+	free(screen->scratchState);
+	free(screen->pending);
+	EdgeSamplesFree(&screen->samples);
+	free(renderer->frame);
+	free(renderer->frameCumulative);
+	EdgeSamplesFree(&renderer->frameSamples);
+	HistogramFree(&renderer->histogram);
+	ConditionDestroy(&renderer->wake);
+	MutexDestroy(&renderer->frameLock);
+	MutexDestroy(&renderer->lock);
+}
+
+void RendererPost(Renderer* renderer, const RenderRequest* request) {
+	MutexLock(&renderer->lock);
+	renderer->request = *request;
+	AtomicAdd(&renderer->generation, 1);
+	ConditionBroadcast(&renderer->wake);
+	MutexUnlock(&renderer->lock);
+}
+
+const Shade* RendererLockFrame(Renderer* renderer, int* width, int* height, unsigned* revision) {
+	MutexLock(&renderer->frameLock);
+	*width = renderer->frameWidth;
+	*height = renderer->frameHeight;
+	*revision = renderer->frameRevision;
+	return renderer->frame;
+}
+
+void RendererUnlockFrame(Renderer* renderer) {
+	MutexUnlock(&renderer->frameLock);
+}
+
+const uint32_t* RendererFrameHistogram(Renderer* renderer) {
+	return renderer->frameEqualized ? renderer->frameCumulative : NULL;
+}
+
+const EdgeSamples* RendererFrameSamples(Renderer* renderer) {
+	return &renderer->frameSamples;
+}
@@ -0,0 +1,568 @@
+#include "mandelbrot.h"
+#include "image.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <direct.h>
+typedef SOCKET Socket;
+#define NO_SOCKET INVALID_SOCKET
+#define SEND_FLAGS 0
+static void CloseSocket(Socket s) { closesocket(s); }
+static void MakeDirectory(const char* path) { _mkdir(path); }
+#else
+#include <errno.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+typedef int Socket;
+#define NO_SOCKET (-1)
+#ifdef MSG_NOSIGNAL
+#define SEND_FLAGS MSG_NOSIGNAL		//a browser closing the connection must not kill the server
+#else
+#define SEND_FLAGS 0
+#endif
+static void CloseSocket(Socket s) { close(s); }
+static void MakeDirectory(const char* path) { mkdir(path, 0755); }
+#endif
+
+/*
+	Map tile server
+
+	Serves GET /z/x/y.png tiles of the Mandelbrot set on localhost in the usual slippy map
+	layout: zoom 0 is one tile covering the set, every zoom level splits the tiles of the
+	previous one in four, x runs right and y down. ?iterations=N and ?palette=R,G,B override
+	the defaults from the command line.
+
+	A tile is looked up in three places. An in memory LRU keyed by (z, x, y, iterations,
+	palette) holds the PNG bytes of recently served tiles up to a byte budget. Behind it is
+	a pyramid of PNG files, cache/<settings>/z/x/y.png, where <settings> is a hash of
+	everything besides the position that changes the pixels, so a changed setting never
+	reads a stale tile. Only a tile found in neither is rendered, written to the pyramid and
+	kept in memory.
+
+	A tile that is being loaded or rendered already has its LRU entry, marked busy. Other
+	requests for it wait for that entry instead of starting another render, so a map that
+	asks for the same tiles from several connections renders each of them once. Renders
+	run one at a time, each spread over the whole worker pool.
+*/
+
+#define SERVER_TILE_SIZE 256
+#define SERVER_THREADS 8			//connections handled at once
+#define SERVER_MAX_ZOOM 48			//tile corners stay exact doubles up to here
+#define SERVER_BUCKETS 4096
+#define REQUEST_SIZE 4096
+
+//zoom 0 tile
+#define WORLD_LEFT -2.75
+#define WORLD_TOP 2.0
+#define WORLD_SIZE 4.0
+
+typedef struct TileKey {
+	long long x, y;				//beyond int from zoom 31 on
+	int z;
+	int iterations;
+	float weights[3];
+}TileKey;
+
+typedef struct CacheEntry {
+	TileKey key;
+	uint8_t* data;				//PNG file, NULL while busy or after a failure
+	size_t size;
+	bool busy;					//being loaded or rendered by one request, the others wait
+	bool failed;
+	int users;					//requests holding the entry, it is not evicted while they do
+
+	struct CacheEntry* nextInBucket;
+	struct CacheEntry* newer;	//LRU list, most recently used at the head
+	struct CacheEntry* older;
+}CacheEntry;
+
+typedef struct TileServer {
+	Socket listener;
+	const char* cacheDirectory;
+	int iterations;				//defaults of the requests
+	float weights[3];
+
+	Mutex lock;					//everything below
+	Condition finished;			//a busy entry became ready or failed
+	CacheEntry* buckets[SERVER_BUCKETS];
+	CacheEntry* newest;
+	CacheEntry* oldest;
+	size_t bytes, budget;
+	long long memoryHits, diskHits, renders, coalesced;
+
+	Mutex renderLock;			//renders set maxIter and share the pool
+}TileServer;
+
+
+static uint64_t HashBytes(uint64_t hash, const void* data, size_t size) {
+	const uint8_t* bytes = (const uint8_t*)data;
+	for (size_t i = 0; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+static uint64_t HashKey(const TileKey* key) {
+	return HashBytes(14695981039346656037ull, key, sizeof(TileKey));
+}
+
+//everything except the position, names the directory of the pyramid
+static uint64_t HashSettings(const TileKey* key) {
+	uint64_t hash = HashBytes(14695981039346656037ull, &key->iterations, sizeof(int));
+	hash = HashBytes(hash, key->weights, sizeof(key->weights));
+	int layout[2] = { SERVER_TILE_SIZE, 1 };	//tile size and file format version
+	return HashBytes(hash, layout, sizeof(layout));
+}
+
+
+//the caller holds the lock
+static void Unlink(TileServer* server, CacheEntry* entry) {
+	if (entry->newer)
+		entry->newer->older = entry->older;
+	else
+		server->newest = entry->older;
+	if (entry->older)
+		entry->older->newer = entry->newer;
+	else
+		server->oldest = entry->newer;
+	entry->newer = entry->older = NULL;
+}
+
+static void PushNewest(TileServer* server, CacheEntry* entry) {
+	entry->older = server->newest;
+	entry->newer = NULL;
+	if (server->newest)
+		server->newest->newer = entry;
+	server->newest = entry;
+	if (!server->oldest)
+		server->oldest = entry;
+}
+
+static void RemoveEntry(TileServer* server, CacheEntry* entry) {
+	CacheEntry** link = &server->buckets[HashKey(&entry->key) % SERVER_BUCKETS];
+	while (*link != entry) {
+		link = &(*link)->nextInBucket;
+	}
+	*link = entry->nextInBucket;
+	Unlink(server, entry);
+	server->bytes -= entry->size;
+	free(entry->data);
+	free(entry);
+}
+
+//drops the least recently used tiles until the budget holds, busy and used ones are skipped
+static void Evict(TileServer* server) {
+	CacheEntry* entry = server->oldest;
+	while (entry && server->bytes > server->budget) {
+		CacheEntry* newer = entry->newer;
+		if (!entry->busy && entry->users == 0)
+			RemoveEntry(server, entry);
+		entry = newer;
+	}
+}
+
+
+static void TilePath(const TileServer* server, const TileKey* key, char* path, size_t size, int depth) {
+	char settings[17];
+	snprintf(settings, sizeof(settings), "%016llx", (unsigned long long)HashSettings(key));
+	switch (depth) {
+	case 0: snprintf(path, size, "%s", server->cacheDirectory); break;
+	case 1: snprintf(path, size, "%s/%s", server->cacheDirectory, settings); break;
+	case 2: snprintf(path, size, "%s/%s/%d", server->cacheDirectory, settings, key->z); break;
+	case 3: snprintf(path, size, "%s/%s/%d/%lld", server->cacheDirectory, settings, key->z, key->x); break;
+	default: snprintf(path, size, "%s/%s/%d/%lld/%lld.png", server->cacheDirectory, settings, key->z, key->x, key->y); break;
+	}
+}
+
+static uint8_t* ReadFile(const char* path, size_t* size) {
+	FILE* file = fopen(path, "rb");
+	if (!file)
+		return NULL;
+	fseek(file, 0, SEEK_END);
+	long length = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	uint8_t* data = length > 0 ? (uint8_t*)malloc(length) : NULL;
+	if (data && fread(data, 1, length, file) != (size_t)length) {
+		free(data);
+		data = NULL;
+	}
+	fclose(file);
+	*size = data ? (size_t)length : 0;
+	return data;
+}
+
+//renders the tile into the pyramid and returns the file, NULL when it could not be written
+static uint8_t* RenderTile(TileServer* server, const TileKey* key, size_t* size) {
+	const int n = SERVER_TILE_SIZE;
+	Shade* colors = (Shade*)malloc(n * n * sizeof(Shade));
+	uint8_t* pixels = (uint8_t*)malloc(n * n * 3);
+
+	//tile corners are multiples of a power of two, exact in double and in Fixed
+	double tileSize = WORLD_SIZE / (double)(1ull << key->z);
+	Viewport viewport;
+	viewport.centerReal = FixedFromDouble(WORLD_LEFT + (key->x + 0.5) * tileSize);
+	viewport.centerImag = FixedFromDouble(WORLD_TOP - (key->y + 0.5) * tileSize);
+	viewport.spanReal = tileSize;
+	viewport.spanImag = tileSize;
+
+	MutexLock(&server->renderLock);
+	maxIter = key->iterations;
+	RenderTiles(&viewport, n, n, colors, NULL, 0, NULL, NULL);
+	MutexUnlock(&server->renderLock);
+
+	Palette palette = { 0 };
+	PaletteUpdate(&palette, key->weights);
+	ColorizePixels(colors, n * n, &palette, pixels, 3);
+	PaletteFree(&palette);
+
+	//directories first, then a temporary file that only becomes the tile once it is complete
+	char path[512], temporary[520];
+	for (int depth = 0; depth < 4; depth++) {
+		TilePath(server, key, path, sizeof(path), depth);
+		MakeDirectory(path);
+	}
+	TilePath(server, key, path, sizeof(path), 4);
+	snprintf(temporary, sizeof(temporary), "%s.part", path);
+
+	ImageWriter* image = ImageOpen(temporary, n, n);
+	bool ok = image != NULL;
+	//frame rows run bottom up, the file starts with the top row
+	for (int y = n - 1; y >= 0 && ok; y--) {
+		ok = ImageWriteRows(image, pixels + (size_t)y * n * 3, 1) != 0;
+	}
+	if (image)
+		ok = ImageClose(image) && ok;
+	remove(path);
+	ok = ok && rename(temporary, path) == 0;
+	if (!ok)
+		remove(temporary);
+
+	free(colors);
+	free(pixels);
+	return ok ? ReadFile(path, size) : NULL;
+}
+
+//copies the PNG of a tile into *data, returns false when it could not be produced
+static bool GetTile(TileServer* server, const TileKey* key, uint8_t** data, size_t* size) {
+	uint64_t hash = HashKey(key);
+	MutexLock(&server->lock);
+	CacheEntry* entry = server->buckets[hash % SERVER_BUCKETS];
+	while (entry && memcmp(&entry->key, key, sizeof(TileKey)) != 0) {
+		entry = entry->nextInBucket;
+	}
+	if (entry)
+		entry->users += 1;
+
+	if (entry && !entry->failed) {
+		if (entry->busy) {
+			server->coalesced += 1;
+			while (entry->busy) {
+				ConditionWait(&server->finished, &server->lock);
+			}
+		}
+		else {
+			server->memoryHits += 1;
+		}
+	}
+	else {
+		//this request loads the tile, later ones for it wait on the entry
+		if (!entry) {
+			entry = (CacheEntry*)calloc(1, sizeof(CacheEntry));
+			entry->key = *key;
+			entry->users = 1;
+			entry->nextInBucket = server->buckets[hash % SERVER_BUCKETS];
+			server->buckets[hash % SERVER_BUCKETS] = entry;
+			PushNewest(server, entry);
+		}
+		entry->busy = true;
+		entry->failed = false;
+		MutexUnlock(&server->lock);
+
+		char path[512];
+		TilePath(server, key, path, sizeof(path), 4);
+		size_t loadedSize = 0;
+		uint8_t* loaded = ReadFile(path, &loadedSize);
+		bool rendered = !loaded;
+		if (!loaded)
+			loaded = RenderTile(server, key, &loadedSize);
+
+		MutexLock(&server->lock);
+		entry->data = loaded;
+		entry->size = loadedSize;
+		entry->failed = !loaded;
+		entry->busy = false;
+		server->bytes += loadedSize;
+		if (rendered)
+			server->renders += 1;
+		else
+			server->diskHits += 1;
+		ConditionBroadcast(&server->finished);
+	}
+
+	bool ok = !entry->failed;
+	if (ok) {
+		*data = (uint8_t*)malloc(entry->size);
+		memcpy(*data, entry->data, entry->size);
+		*size = entry->size;
+		Unlink(server, entry);
+		PushNewest(server, entry);
+	}
+	//only now may the entry go, a tile larger than the whole budget is served once and dropped
+	entry->users -= 1;
+	Evict(server);
+	MutexUnlock(&server->lock);
+	return ok;
+}
+
+
+static bool SendAll(Socket s, const void* data, size_t size) {
+	const char* bytes = (const char*)data;
+	while (size > 0) {
+		int sent = send(s, bytes, (int)minimum(size, (size_t)1 << 20), SEND_FLAGS);
+		if (sent <= 0)
+			return false;
+		bytes += sent;
+		size -= sent;
+	}
+	return true;
+}
+
+static void Respond(Socket s, const char* status, const char* type, const void* body, size_t size) {
+	char header[256];
+	int length = snprintf(header, sizeof(header),
+		"HTTP/1.1 %s\r\nContent-Type: %s\r\nContent-Length: %llu\r\nAccess-Control-Allow-Origin: *\r\n"
+		"Cache-Control: public, max-age=86400\r\nConnection: close\r\n\r\n", status, type, (unsigned long long)size);
+	if (SendAll(s, header, length))
+		SendAll(s, body, size);
+}
+
+static void RespondText(Socket s, const char* status, const char* text) {
+	Respond(s, status, "text/plain", text, strlen(text));
+}
+
+//"/z/x/y.png" with optional "?iterations=N&palette=R,G,B"
+static bool ParseTile(const TileServer* server, const char* target, TileKey* key) {
+	memset(key, 0, sizeof(TileKey));	//padding is hashed and compared too
+	key->iterations = server->iterations;
+	memcpy(key->weights, server->weights, sizeof(key->weights));
+
+	int used = 0;
+	if (sscanf(target, "/%d/%lld/%lld.png%n", &key->z, &key->x, &key->y, &used) != 3 || used == 0)
+		return false;
+	if (key->z < 0 || key->z > SERVER_MAX_ZOOM)
+		return false;
+	long long tiles = 1ll << key->z;
+	if (key->x < 0 || key->x >= tiles || key->y < 0 || key->y >= tiles)
+		return false;
+
+	const char* query = target + used;
+	if (*query == '?')
+		query++;
+	else if (*query)
+		return false;
+	while (*query) {
+		if (sscanf(query, "iterations=%d", &key->iterations) == 1) {
+			if (key->iterations < 1 || key->iterations > 1 << 24)
+				return false;
+		}
+		else if (sscanf(query, "palette=%f,%f,%f", &key->weights[0], &key->weights[1], &key->weights[2]) == 3) {
+			//every accepted palette gets its own directory on disk, garbage gets a 404
+			if (!PaletteWeightsValid(key->weights))
+				return false;
+		}
+		else {
+			return false;
+		}
+		const char* next = strchr(query, '&');
+		query = next ? next + 1 : query + strlen(query);
+	}
+	return true;
+}
+
+static void HandleConnection(TileServer* server, Socket s) {
+	char request[REQUEST_SIZE];
+	int length = 0;
+	while (length < REQUEST_SIZE - 1) {
+		int received = recv(s, request + length, REQUEST_SIZE - 1 - length, 0);
+		if (received <= 0)
+			break;
+		length += received;
+		request[length] = 0;
+		if (strstr(request, "\r\n\r\n"))
+			break;
+	}
+	request[length] = 0;
+
+	char method[8], target[1024];
+	if (sscanf(request, "%7s %1023s", method, target) != 2) {
+		RespondText(s, "400 Bad Request", "bad request\n");
+		return;
+	}
+	if (strcmp(method, "GET") != 0) {
+		RespondText(s, "405 Method Not Allowed", "only GET is supported\n");
+		return;
+	}
+
+	if (strcmp(target, "/") == 0 || strcmp(target, "/stats") == 0) {
+		char text[512];
+		MutexLock(&server->lock);
+		snprintf(text, sizeof(text),
+			"Mandelbrot tiles: /{z}/{x}/{y}.png?iterations=N&palette=R,G,B\n"
+			"memory hits %lld, disk hits %lld, renders %lld, coalesced %lld, %llu bytes in memory\n",
+			server->memoryHits, server->diskHits, server->renders, server->coalesced, (unsigned long long)server->bytes);
+		MutexUnlock(&server->lock);
+		RespondText(s, "200 OK", text);
+		return;
+	}
+
+	TileKey key;
+	if (!ParseTile(server, target, &key)) {
+		RespondText(s, "404 Not Found", "no such tile\n");
+		return;
+	}
+	uint8_t* data = NULL;
+	size_t size = 0;
+	if (!GetTile(server, &key, &data, &size)) {
+		RespondText(s, "500 Internal Server Error", "tile could not be written to the cache\n");
+		return;
+	}
+	Respond(s, "200 OK", "image/png", data, size);
+	free(data);
+}
+
+//after a failed accept, false when the listener is gone and the thread should stop
+static bool AcceptRecovers(void) {
+#ifdef _WIN32
+	int error = WSAGetLastError();
+	if (error == WSAENOTSOCK || error == WSAEINVAL || error == WSANOTINITIALISED)
+		return false;
+	if (error == WSAEMFILE || error == WSAENOBUFS)
+		ThreadSleep(100);
+#else
+	if (errno == EBADF || errno == ENOTSOCK || errno == EINVAL)
+		return false;
+	if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM)
+		ThreadSleep(100);		//out of descriptors, give the open connections time to close
+#endif
+	return true;
+}
+
+static void ServeConnections(void* data) {
+	TileServer* server = (TileServer*)data;
+	for (;;) {
+		Socket s = accept(server->listener, NULL, NULL);
+		if (s == NO_SOCKET) {
+			if (!AcceptRecovers()) {
+				fprintf(stderr, "serve: accept failed, stopping this connection thread\n");
+				return;
+			}
+			continue;
+		}
+		HandleConnection(server, s);
+		CloseSocket(s);
+	}
+}
+
+
+static void PrintUsage(void) {
+	fprintf(stderr,
+		"usage: mandelbrot serve [options]\n"
+		"  --port N                 port on 127.0.0.1 (default 8080)\n"
+		"  --cache DIRECTORY        tile pyramid on disk (default tiles)\n"
+		"  --memory MB              tiles kept in memory, at least 1 (default 64)\n"
+		"  --iterations N           default maximum iterations (default 256)\n"
+		"  --palette R G B          default color weights (default 5 2 3)\n");
+}
+
+int ServerMain(int argc, char* argv[]) {
+	static TileServer server;
+	int port = 8080, memory = 64;
+	server.cacheDirectory = "tiles";
+	server.iterations = 256;
+	server.weights[0] = 5.0f;
+	server.weights[1] = 2.0f;
+	server.weights[2] = 3.0f;
+
+	for (int i = 0; i < argc; i++) {
+		const char* arg = argv[i];
+		int left = argc - i - 1;
+		bool ok = true;
+
+		if (strcmp(arg, "--port") == 0 && left >= 1) {
+			ok = ParseInt(argv[i + 1], 1, &port) && port < 65536;
+			i += 1;
+		}
+		else if (strcmp(arg, "--cache") == 0 && left >= 1) {
+			server.cacheDirectory = argv[i + 1];
+			i += 1;
+		}
+		else if (strcmp(arg, "--memory") == 0 && left >= 1) {
+			ok = ParseInt(argv[i + 1], 1, &memory);		//at least one tile has to fit
+			i += 1;
+		}
+		else if (strcmp(arg, "--iterations") == 0 && left >= 1) {
+			ok = ParseInt(argv[i + 1], 1, &server.iterations);
+			i += 1;
+		}
+		else if (strcmp(arg, "--palette") == 0 && left >= 3) {
+			ok = ParsePalette(argv + i + 1, server.weights);
+			i += 3;
+		}
+		else {
+			ok = false;
+		}
+
+		if (!ok) {
+			fprintf(stderr, "serve: bad argument %s\n", arg);
+			PrintUsage();
+			return 1;
+		}
+	}
+	server.budget = (size_t)memory << 20;
+
+#ifdef _WIN32
+	WSADATA wsa;
+	if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0)
+		return 1;
+#endif
+
+	server.listener = socket(AF_INET, SOCK_STREAM, 0);
+	int reuse = 1;
+	setsockopt(server.listener, SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse, sizeof(reuse));
+	struct sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	address.sin_port = htons((unsigned short)port);
+	if (server.listener == NO_SOCKET || bind(server.listener, (struct sockaddr*)&address, sizeof(address)) != 0 || listen(server.listener, 64) != 0) {
+		fprintf(stderr, "serve: cannot listen on 127.0.0.1:%d\n", port);
+		return 1;
+	}
+
+	//tiles are always the plain Mandelbrot set
+	fractal.family = FRACTAL_MANDELBROT;
+	fractal.exponent = 2;
+	renderMode = RENDER_BRUTE_FORCE;
+	MutexInit(&server.lock);
+	MutexInit(&server.renderLock);
+	ConditionInit(&server.finished);
+
+	fprintf(stderr, "serving http://127.0.0.1:%d/{z}/{x}/{y}.png from %s\n", port, server.cacheDirectory);
+	Thread threads[SERVER_THREADS];
+	int started = 0;
+	for (int i = 0; i < SERVER_THREADS; i++) {
+		started += ThreadStart(&threads[started], ServeConnections, &server) ? 1 : 0;
+	}
+	for (int i = 0; i < started; i++) {
+		ThreadJoin(threads[i]);
+	}
+	return started ? 0 : 1;
+}
@@ -0,0 +1,226 @@
+#include "mandelbrot.h"
+
+#include <string.h>
+
+/*
+	Mariani-Silver subdivision inside one tile
+
+	Rectangles are inclusive and share their border with the neighbour after a split, so
+	every pixel is iterated at most once; known marks the pixels that have a count already.
+*/
+
+//rectangles this small are iterated directly, splitting them further saves nothing
+#define MIN_SUBDIVIDE 4
+#define BATCH_SIZE 64
+
+typedef struct TileWork {
+	RenderContext* context;
+	Tile tile;
+	Shade* colors;			//the frame, indexed with absolute coordinates
+	RenderStats* stats;
+	TileOrbits* orbits;		//unresolved pixels, NULL when not kept
+
+	int iterations[TILE_SIZE * TILE_SIZE];
+	uint8_t known[TILE_SIZE * TILE_SIZE];
+	uint8_t interior[TILE_SIZE * TILE_SIZE];	//proven interior, only tracked with orbits
+
+	int batchX[BATCH_SIZE], batchY[BATCH_SIZE];
+	PixelOrbit batchOrbits[BATCH_SIZE];
+	int batchCount;
+}TileWork;
+
+static int LocalIndex(const TileWork* work, int x, int y) {
+	return (x - work->tile.x0) + (y - work->tile.y0) * TILE_SIZE;
+}
+
+static void FlushBatch(TileWork* work) {
+	if (work->batchCount == 0)
+		return;
+
+	int iterations[BATCH_SIZE];
+	Shade colors[BATCH_SIZE];
+	RenderContext* context = work->context;
+	PixelOrbit* orbits = work->orbits ? work->batchOrbits : NULL;
+	if (orbits)
+		memset(orbits, 0, work->batchCount * sizeof(PixelOrbit));
+	context->pixels(context, work->batchX, work->batchY, work->batchCount, orbits, iterations, colors, work->stats);
+
+	for (int i = 0; i < work->batchCount; i++) {
+		int x = work->batchX[i], y = work->batchY[i];
+		int local = LocalIndex(work, x, y);
+		work->iterations[local] = iterations[i];
+		work->known[local] = 1;
+		work->colors[x + y * context->width] = colors[i];
+
+		if (orbits) {
+			work->interior[local] = orbits[i].reference == ORBIT_INTERIOR;
+			if (orbits[i].iterations >= maxIter && !work->interior[local]) {
+				orbits[i].index = x + y * context->width;
+				TileOrbitsAppend(work->orbits, &orbits[i]);
+			}
+		}
+	}
+	work->stats->computed += work->batchCount;
+	work->batchCount = 0;
+}
+
+static void Evaluate(TileWork* work, int x, int y) {
+	int local = LocalIndex(work, x, y);
+	if (work->known[local])
+		return;
+
+	//queued pixels are marked right away so shared corners are not queued twice
+	work->known[local] = 1;
+	work->batchX[work->batchCount] = x;
+	work->batchY[work->batchCount] = y;
+	work->batchCount += 1;
+	if (work->batchCount == BATCH_SIZE)
+		FlushBatch(work);
+}
+
+static void EvaluateBorder(TileWork* work, int x0, int y0, int x1, int y1) {
+	for (int x = x0; x <= x1; x++) {
+		Evaluate(work, x, y0);
+		Evaluate(work, x, y1);
+	}
+	for (int y = y0 + 1; y < y1; y++) {
+		Evaluate(work, x0, y);
+		Evaluate(work, x1, y);
+	}
+	FlushBatch(work);
+}
+
+static bool BorderIsUniform(const TileWork* work, int x0, int y0, int x1, int y1) {
+	int value = work->iterations[LocalIndex(work, x0, y0)];
+	for (int x = x0; x <= x1; x++) {
+		if (work->iterations[LocalIndex(work, x, y0)] != value || work->iterations[LocalIndex(work, x, y1)] != value)
+			return false;
+	}
+	for (int y = y0 + 1; y < y1; y++) {
+		if (work->iterations[LocalIndex(work, x0, y)] != value || work->iterations[LocalIndex(work, x1, y)] != value)
+			return false;
+	}
+	return true;
+}
+
+static void VerifyFill(TileWork* work, int x0, int y0, int x1, int y1, int value) {
+	int xs[BATCH_SIZE], ys[BATCH_SIZE], iterations[BATCH_SIZE];
+	Shade colors[BATCH_SIZE];
+	int count = 0;
+
+	for (int y = y0 + 1; y < y1; y++) {
+		for (int x = x0 + 1; x < x1; x++) {
+			xs[count] = x;
+			ys[count] = y;
+			count += 1;
+			if (count == BATCH_SIZE || (x == x1 - 1 && y == y1 - 1)) {
+				//the check pass is not part of the render, its counters are thrown away
+				RenderStats unused = { 0 };
+				work->context->pixels(work->context, xs, ys, count, NULL, iterations, colors, &unused);
+				for (int i = 0; i < count; i++) {
+					if (iterations[i] != value)
+						work->stats->mismatched += 1;
+				}
+				count = 0;
+			}
+		}
+	}
+}
+
+//a border of proven interior pixels encloses only interior, any other filled pixel at the
+//limit has no orbit of its own and is continued from the start
+static void KeepFilledOrbits(TileWork* work, int x0, int y0, int x1, int y1) {
+	bool proven = true;
+	for (int x = x0; x <= x1 && proven; x++) {
+		proven = work->interior[LocalIndex(work, x, y0)] && work->interior[LocalIndex(work, x, y1)];
+	}
+	for (int y = y0 + 1; y < y1 && proven; y++) {
+		proven = work->interior[LocalIndex(work, x0, y)] && work->interior[LocalIndex(work, x1, y)];
+	}
+
+	for (int y = y0 + 1; y < y1; y++) {
+		for (int x = x0 + 1; x < x1; x++) {
+			work->interior[LocalIndex(work, x, y)] = proven;
+			if (proven)
+				continue;
+			PixelOrbit orbit = { 0 };
+			orbit.index = x + y * work->context->width;
+			TileOrbitsAppend(work->orbits, &orbit);
+		}
+	}
+}
+
+static void FillInterior(TileWork* work, int x0, int y0, int x1, int y1, int value) {
+	const int width = work->context->width;
+	Shade* colors = work->colors;
+
+	//blend of the horizontal and vertical interpolation between opposite border pixels
+	for (int y = y0 + 1; y < y1; y++) {
+		float ty = (float)(y - y0) / (y1 - y0);
+		for (int x = x0 + 1; x < x1; x++) {
+			float tx = (float)(x - x0) / (x1 - x0);
+			float horizontal = colors[x0 + y * width] + ((float)colors[x1 + y * width] - colors[x0 + y * width]) * tx;
+			float vertical = colors[x + y0 * width] + ((float)colors[x + y1 * width] - colors[x + y0 * width]) * ty;
+			colors[x + y * width] = (Shade)(0.5f * (horizontal + vertical) + 0.5f);
+
+			int local = LocalIndex(work, x, y);
+			work->iterations[local] = value;
+			work->known[local] = 1;
+		}
+	}
+	work->stats->filled += (long long)(x1 - x0 - 1) * (y1 - y0 - 1);
+
+	if (work->orbits && value >= maxIter)
+		KeepFilledOrbits(work, x0, y0, x1, y1);
+
+	if (verifySubdivision)
+		VerifyFill(work, x0, y0, x1, y1, value);
+}
+
+static void SubdivideRect(TileWork* work, int x0, int y0, int x1, int y1) {
+	EvaluateBorder(work, x0, y0, x1, y1);
+
+	//nothing inside the border
+	if (x1 - x0 < 2 || y1 - y0 < 2)
+		return;
+
+	if (BorderIsUniform(work, x0, y0, x1, y1)) {
+		FillInterior(work, x0, y0, x1, y1, work->iterations[LocalIndex(work, x0, y0)]);
+		return;
+	}
+
+	if (x1 - x0 <= MIN_SUBDIVIDE && y1 - y0 <= MIN_SUBDIVIDE) {
+		for (int y = y0 + 1; y < y1; y++) {
+			for (int x = x0 + 1; x < x1; x++) {
+				Evaluate(work, x, y);
+			}
+		}
+		FlushBatch(work);
+		return;
+	}
+
+	//split the longer side, both halves share the middle line
+	if (x1 - x0 >= y1 - y0) {
+		int middle = (x0 + x1) / 2;
+		SubdivideRect(work, x0, y0, middle, y1);
+		SubdivideRect(work, middle, y0, x1, y1);
+	}
+	else {
+		int middle = (y0 + y1) / 2;
+		SubdivideRect(work, x0, y0, x1, middle);
+		SubdivideRect(work, x0, middle, x1, y1);
+	}
+}
+
+void SubdivideTile(RenderContext* context, Tile tile, Shade* colors, RenderStats* stats, TileOrbits* orbits) {
+	TileWork work;
+	work.context = context;
+	work.tile = tile;
+	work.colors = colors;
+	work.stats = stats;
+	work.orbits = orbits;
+	work.batchCount = 0;
+	memset(work.known, 0, sizeof(work.known));
+
+	SubdivideRect(&work, tile.x0, tile.y0, tile.x1 - 1, tile.y1 - 1);
+}
@@ -0,0 +1,401 @@
+#include "threads.h"
+
+#include <stdlib.h>
+
+#ifdef _WIN32
+
+typedef struct ThreadStartInfo {
+	ThreadProc proc;
+	void* data;
+}ThreadStartInfo;
+
+static DWORD WINAPI ThreadEntry(LPVOID param) {
+	ThreadStartInfo info = *(ThreadStartInfo*)param;
+	free(param);
+	info.proc(info.data);
+	return 0;
+}
+
+int ThreadStart(Thread* thread, ThreadProc proc, void* data) {
+	ThreadStartInfo* info = (ThreadStartInfo*)malloc(sizeof(ThreadStartInfo));
+	info->proc = proc;
+	info->data = data;
+	*thread = CreateThread(NULL, 0, ThreadEntry, info, 0, NULL);
+	if (*thread == NULL) {
+		free(info);
+		return 0;
+	}
+	return 1;
+}
+
+void ThreadJoin(Thread thread) {
+	WaitForSingleObject(thread, INFINITE);
+	CloseHandle(thread);
+}
+
+void ThreadSleep(int milliseconds) {
+	Sleep(milliseconds);
+}
+
+int ProcessorCount(void) {
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return (int)info.dwNumberOfProcessors;
+}
+
+void MutexInit(Mutex* mutex) { InitializeCriticalSection(mutex); }
+void MutexDestroy(Mutex* mutex) { DeleteCriticalSection(mutex); }
+void MutexLock(Mutex* mutex) { EnterCriticalSection(mutex); }
+void MutexUnlock(Mutex* mutex) { LeaveCriticalSection(mutex); }
+
+void ConditionInit(Condition* condition) { InitializeConditionVariable(condition); }
+void ConditionDestroy(Condition* condition) { (void)condition; }
+void ConditionWait(Condition* condition, Mutex* mutex) { SleepConditionVariableCS(condition, mutex, INFINITE); }
+void ConditionBroadcast(Condition* condition) { WakeAllConditionVariable(condition); }
+
+int32_t AtomicLoad(volatile int32_t* value) {
+	return InterlockedCompareExchange((volatile LONG*)value, 0, 0);
+}
+
+void AtomicStore(volatile int32_t* value, int32_t x) {
+	InterlockedExchange((volatile LONG*)value, x);
+}
+
+int32_t AtomicAdd(volatile int32_t* value, int32_t x) {
+	return InterlockedExchangeAdd((volatile LONG*)value, x) + x;
+}
+
+int32_t AtomicCompareExchange(volatile int32_t* value, int32_t expected, int32_t desired) {
+	return InterlockedCompareExchange((volatile LONG*)value, desired, expected);
+}
+
+double TimeNow(void) {
+	LARGE_INTEGER frequency, counter;
+	QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&counter);
+	return (double)counter.QuadPart / (double)frequency.QuadPart;
+}
+
+#else
+
+#include <time.h>
+#include <unistd.h>
+
+typedef struct ThreadStartInfo {
+	ThreadProc proc;
+	void* data;
+}ThreadStartInfo;
+
+static void* ThreadEntry(void* param) {
+	ThreadStartInfo info = *(ThreadStartInfo*)param;
+	free(param);
+	info.proc(info.data);
+	return NULL;
+}
+
+int ThreadStart(Thread* thread, ThreadProc proc, void* data) {
+	ThreadStartInfo* info = (ThreadStartInfo*)malloc(sizeof(ThreadStartInfo));
+	info->proc = proc;
+	info->data = data;
+	if (pthread_create(thread, NULL, ThreadEntry, info) != 0) {
+		free(info);
+		return 0;
+	}
+	return 1;
+}
+
+void ThreadJoin(Thread thread) {
+	pthread_join(thread, NULL);
+}
+
+void ThreadSleep(int milliseconds) {
+	struct timespec duration;
+	duration.tv_sec = milliseconds / 1000;
+	duration.tv_nsec = (long)(milliseconds % 1000) * 1000000L;
+	nanosleep(&duration, NULL);
+}
+
+int ProcessorCount(void) {
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	return count > 0 ? (int)count : 1;
+}
+
+void MutexInit(Mutex* mutex) { pthread_mutex_init(mutex, NULL); }
+void MutexDestroy(Mutex* mutex) { pthread_mutex_destroy(mutex); }
+void MutexLock(Mutex* mutex) { pthread_mutex_lock(mutex); }
+void MutexUnlock(Mutex* mutex) { pthread_mutex_unlock(mutex); }
+
+void ConditionInit(Condition* condition) { pthread_cond_init(condition, NULL); }
+void ConditionDestroy(Condition* condition) { pthread_cond_destroy(condition); }
+void ConditionWait(Condition* condition, Mutex* mutex) { pthread_cond_wait(condition, mutex); }
+void ConditionBroadcast(Condition* condition) { pthread_cond_broadcast(condition); }
+
+int32_t AtomicLoad(volatile int32_t* value) {
+	return __atomic_load_n(value, __ATOMIC_SEQ_CST);
+}
+
+void AtomicStore(volatile int32_t* value, int32_t x) {
+	__atomic_store_n(value, x, __ATOMIC_SEQ_CST);
+}
+
+int32_t AtomicAdd(volatile int32_t* value, int32_t x) {
+	return __atomic_add_fetch(value, x, __ATOMIC_SEQ_CST);
+}
+
+int32_t AtomicCompareExchange(volatile int32_t* value, int32_t expected, int32_t desired) {
+	__atomic_compare_exchange_n(value, &expected, desired, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+	return expected;
+}
+
+double TimeNow(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (double)now.tv_sec + (double)now.tv_nsec * 1e-9;
+}
+
+#endif
+
+
+/*
+	Work-stealing pool
+*/
+
+#define MAX_WORKERS 256
+
+typedef struct Deque {
+	Mutex lock;
+	int* items;
+	int head, tail;		//owner pops at tail, thieves steal at head
+}Deque;
+
+typedef struct Pool {
+	int workerCount;
+	Thread threads[MAX_WORKERS];
+	Deque deques[MAX_WORKERS];
+	int* items;
+	int capacity;
+
+	Mutex runLock;		//serializes PoolRun callers
+	Mutex lock;
+	Condition wake;
+	Condition done;
+
+	//current job, only changed while no worker is inside it
+	JobProc proc;
+	void* data;
+	int active;
+	int generation;
+	int busy;
+	int shutdown;
+	volatile int32_t remaining;
+}Pool;
+
+static Pool pool;
+
+typedef struct WorkerStart {
+	int index;
+}WorkerStart;
+
+static int DequePop(Deque* deque, int* item) {
+	int found = 0;
+	MutexLock(&deque->lock);
+	if (deque->tail > deque->head) {
+		deque->tail -= 1;
+		*item = deque->items[deque->tail];
+		found = 1;
+	}
+	MutexUnlock(&deque->lock);
+	return found;
+}
+
+static int DequeSteal(Deque* deque, int* item) {
+	int found = 0;
+	MutexLock(&deque->lock);
+	if (deque->tail > deque->head) {
+		*item = deque->items[deque->head];
+		deque->head += 1;
+		found = 1;
+	}
+	MutexUnlock(&deque->lock);
+	return found;
+}
+
+static int FindWork(int worker, int* item) {
+	if (DequePop(&pool.deques[worker], item))
+		return 1;
+
+	for (int i = 1; i < pool.workerCount; i++) {
+		int victim = (worker + i) % pool.workerCount;
+		if (DequeSteal(&pool.deques[victim], item))
+			return 1;
+	}
+	return 0;
+}
+
+static void DrainJob(JobProc proc, void* data, int worker) {
+	int item;
+	while (FindWork(worker, &item)) {
+		proc(data, item, worker);
+		if (AtomicAdd(&pool.remaining, -1) == 0) {
+			MutexLock(&pool.lock);
+			ConditionBroadcast(&pool.done);
+			MutexUnlock(&pool.lock);
+		}
+	}
+}
+
+static void WorkerMain(void* param) {
+	int worker = ((WorkerStart*)param)->index;
+	free(param);
+
+	int seen = 0;
+	for (;;) {
+		MutexLock(&pool.lock);
+		while (!pool.shutdown && (!pool.active || pool.generation == seen))
+			ConditionWait(&pool.wake, &pool.lock);
+		if (pool.shutdown) {
+			MutexUnlock(&pool.lock);
+			return;
+		}
+		seen = pool.generation;
+		JobProc proc = pool.proc;
+		void* data = pool.data;
+		pool.busy += 1;
+		MutexUnlock(&pool.lock);
+
+		DrainJob(proc, data, worker);
+
+		MutexLock(&pool.lock);
+		pool.busy -= 1;
+		if (pool.busy == 0)
+			ConditionBroadcast(&pool.done);
+		MutexUnlock(&pool.lock);
+	}
+}
+
+void PoolInit(int workerCount) {
+	if (pool.workerCount)
+		return;
+
+	if (workerCount <= 0)
+		workerCount = ProcessorCount();
+	if (workerCount > MAX_WORKERS)
+		workerCount = MAX_WORKERS;
+
+	pool.workerCount = workerCount;
+	MutexInit(&pool.runLock);
+	MutexInit(&pool.lock);
+	ConditionInit(&pool.wake);
+	ConditionInit(&pool.done);
+	for (int i = 0; i < workerCount; i++) {
+		MutexInit(&pool.deques[i].lock);
+	}
+
+	//worker 0 is whoever calls PoolRun
+	for (int i = 1; i < workerCount; i++) {
+		WorkerStart* start = (WorkerStart*)malloc(sizeof(WorkerStart));
+		start->index = i;
+		if (!ThreadStart(&pool.threads[i], WorkerMain, start)) {
+			free(start);
+			pool.workerCount = i;
+			break;
+		}
+	}
+}
+
+void PoolShutdown(void) {
+	if (!pool.workerCount)
+		return;
+
+	MutexLock(&pool.lock);
+	pool.shutdown = 1;
+	ConditionBroadcast(&pool.wake);
+	MutexUnlock(&pool.lock);
+
+	for (int i = 1; i < pool.workerCount; i++) {
+		ThreadJoin(pool.threads[i]);
+	}
+	for (int i = 0; i < pool.workerCount; i++) {
+		MutexDestroy(&pool.deques[i].lock);
+	}
+	MutexDestroy(&pool.runLock);
+	MutexDestroy(&pool.lock);
+	ConditionDestroy(&pool.wake);
+	ConditionDestroy(&pool.done);
+	free(pool.items);
+	pool = (Pool){ 0 };
+}
+
+int PoolWorkerCount(void) {
+	return pool.workerCount ? pool.workerCount : 1;
+}
+
+void PoolRun(JobProc proc, void* data, int count) {
+	if (count <= 0)
+		return;
+
+	if (pool.workerCount <= 1) {
+		for (int i = 0; i < count; i++) {
+			proc(data, i, 0);
+		}
+		return;
+	}
+
+	MutexLock(&pool.runLock);
+
+	//deal the items round robin so every deque holds a mix of cheap and expensive tiles
+	int perWorker = (count + pool.workerCount - 1) / pool.workerCount;
+	if (perWorker * pool.workerCount > pool.capacity) {
+		pool.capacity = perWorker * pool.workerCount;
+		pool.items = (int*)realloc(pool.items, pool.capacity * sizeof(int));
+	}
+	for (int w = 0; w < pool.workerCount; w++) {
+		Deque* deque = &pool.deques[w];
+		deque->items = pool.items + w * perWorker;
+		deque->head = 0;
+		deque->tail = 0;
+	}
+	//pushed in reverse so the owner pops its items in increasing order
+	for (int i = count - 1; i >= 0; i--) {
+		Deque* deque = &pool.deques[i % pool.workerCount];
+		deque->items[deque->tail++] = i;
+	}
+
+	AtomicStore(&pool.remaining, count);
+
+	MutexLock(&pool.lock);
+	pool.proc = proc;
+	pool.data = data;
+	pool.generation += 1;
+	pool.active = 1;
+	ConditionBroadcast(&pool.wake);
+	MutexUnlock(&pool.lock);
+
+	DrainJob(proc, data, 0);
+
+	//no worker may still hold this job when the deques are refilled for the next one
+	MutexLock(&pool.lock);
+	while (AtomicLoad(&pool.remaining) != 0 || pool.busy != 0)
+		ConditionWait(&pool.done, &pool.lock);
+	pool.active = 0;
+	MutexUnlock(&pool.lock);
+
+	MutexUnlock(&pool.runLock);
+}
+
+
+int TileCount(int width, int height, int tileSize) {
+	int columns = (width + tileSize - 1) / tileSize;
+	int rows = (height + tileSize - 1) / tileSize;
+	return columns * rows;
+}
+
+Tile TileGet(int index, int width, int height, int tileSize) {
+	int columns = (width + tileSize - 1) / tileSize;
+	Tile tile;
+	tile.x0 = (index % columns) * tileSize;
+	tile.y0 = (index / columns) * tileSize;
+	tile.x1 = tile.x0 + tileSize < width ? tile.x0 + tileSize : width;
+	tile.y1 = tile.y0 + tileSize < height ? tile.y0 + tileSize : height;
+	return tile;
+}
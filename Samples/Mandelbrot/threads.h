@@ -0,0 +1,85 @@
+#ifndef THREADS_H
+#define THREADS_H
+
+/*
+	Minimal threading layer for the Mandelbrot sample: threads, locks, atomics
+	and a work-stealing pool that the renderers use to spread tiles over all cores.
+	Win32 and pthreads are supported, nothing else is needed.
+*/
+
+#include <stdint.h>
+
+#ifdef _WIN32
+//include this header before glfw3.h so windows.h gets to define APIENTRY first
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+typedef HANDLE Thread;
+typedef CRITICAL_SECTION Mutex;
+typedef CONDITION_VARIABLE Condition;
+#else
+#include <pthread.h>
+typedef pthread_t Thread;
+typedef pthread_mutex_t Mutex;
+typedef pthread_cond_t Condition;
+#endif
+
+typedef void (*ThreadProc)(void* data);
+
+int ThreadStart(Thread* thread, ThreadProc proc, void* data);
+void ThreadJoin(Thread thread);
+void ThreadSleep(int milliseconds);
+int ProcessorCount(void);
+
+void MutexInit(Mutex* mutex);
+void MutexDestroy(Mutex* mutex);
+void MutexLock(Mutex* mutex);
+void MutexUnlock(Mutex* mutex);
+
+void ConditionInit(Condition* condition);
+void ConditionDestroy(Condition* condition);
+void ConditionWait(Condition* condition, Mutex* mutex);
+void ConditionBroadcast(Condition* condition);
+
+//sequentially consistent atomics on 32 bit integers
+int32_t AtomicLoad(volatile int32_t* value);
+void AtomicStore(volatile int32_t* value, int32_t x);
+int32_t AtomicAdd(volatile int32_t* value, int32_t x);		//returns the new value
+int32_t AtomicCompareExchange(volatile int32_t* value, int32_t expected, int32_t desired);	//returns the previous value
+
+//seconds since an arbitrary point, for timing renders
+double TimeNow(void);
+
+
+/*
+	Work-stealing tile pool
+
+	A job is a number of independent work items (usually screen tiles). Items are dealt
+	out round robin into one deque per worker, every worker drains its own deque from the
+	back and, once empty, steals from the front of the others. Tiles close to the set
+	boundary are many times more expensive than exterior ones, stealing keeps every core
+	busy until the last expensive tile is done instead of waiting on one slow row band.
+*/
+
+//worker is the index of the executing thread in [0, PoolWorkerCount()), useful for per-thread scratch data
+typedef void (*JobProc)(void* data, int item, int worker);
+
+void PoolInit(int workerCount);		//0 means one worker per processor
+void PoolShutdown(void);
+int PoolWorkerCount(void);
+
+//runs proc for every item in [0, count) and returns once all of them finished, the calling thread works as worker 0
+void PoolRun(JobProc proc, void* data, int count);
+
+
+typedef struct Tile {
+	int x0, y0, x1, y1;		//half open pixel rectangle
+}Tile;
+
+#define TILE_SIZE 32
+
+int TileCount(int width, int height, int tileSize);
+Tile TileGet(int index, int width, int height, int tileSize);
+
+#endif
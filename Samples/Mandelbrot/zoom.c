@@ -0,0 +1,456 @@
+#include "mandelbrot.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+/*
+	Zoom animations
+
+	Renders a flight along a keyframe path without a window and writes the frames as a
+	YUV4MPEG2 (Y4M) stream, which ffmpeg and most encoders read straight from a pipe. A
+	keyframe gives a time, a center and a zoom level, the log10 of the magnification. Between
+	two keyframes the zoom level changes linearly with time, so the zoom speed looks steady,
+	and the center moves such that the point the two keyframes zoom about stays in place.
+
+	Consecutive frames mostly show the same points. A pixel of the new frame whose position
+	lies within --reuse pixels of a sample of the previous frame takes that shade, only the
+	remaining pixels are iterated. Every pixel remembers how far its sample is from it, so a
+	sample reused over many frames never ends up further away than that.
+
+	Frames go through a ring of shade buffers. The pool renders into a free one while a writer
+	thread colors, converts and writes the frames before it in order; rendering only waits
+	when the encoder on the other end of the stream falls behind.
+*/
+
+#define ZOOM_SLOTS 3		//frames in flight
+#define ZOOM_SPAN 4.0		//view width at zoom level 0
+
+typedef struct Keyframe {
+	double time;			//seconds
+	Fixed centerReal, centerImag;
+	double zoom;			//span is ZOOM_SPAN / 10^zoom
+}Keyframe;
+
+typedef struct ZoomOutput {
+	FILE* file;
+	int width, height;
+	const Palette* palette;
+
+	Mutex lock;
+	Condition changed;
+	Shade* frames[ZOOM_SLOTS];
+	EdgeSamples samples[ZOOM_SLOTS];	//of the supersampled pixels of every frame
+	bool full[ZOOM_SLOTS];
+	bool finished;			//no more frames are coming
+	bool failed;
+}ZoomOutput;
+
+//BT.601 studio range 4:2:0, rows top first as Y4M stores them
+static bool WriteFrame(FILE* file, const uint8_t* rgb, int width, int height, uint8_t* planes) {
+	uint8_t* luma = planes;
+	uint8_t* blue = luma + (size_t)width * height;
+	uint8_t* red = blue + (size_t)width * height / 4;
+
+	for (int row = 0; row < height; row++) {
+		const uint8_t* p = rgb + (size_t)(height - 1 - row) * width * 3;
+		for (int x = 0; x < width; x++, p += 3) {
+			luma[(size_t)row * width + x] = (uint8_t)(16 + ((66 * p[0] + 129 * p[1] + 25 * p[2] + 128) >> 8));
+		}
+	}
+	for (int row = 0; row < height / 2; row++) {
+		const uint8_t* top = rgb + (size_t)(height - 1 - 2 * row) * width * 3;
+		const uint8_t* bottom = top - (size_t)width * 3;
+		for (int x = 0; x < width / 2; x++) {
+			int r = (top[6 * x] + top[6 * x + 3] + bottom[6 * x] + bottom[6 * x + 3] + 2) >> 2;
+			int g = (top[6 * x + 1] + top[6 * x + 4] + bottom[6 * x + 1] + bottom[6 * x + 4] + 2) >> 2;
+			int b = (top[6 * x + 2] + top[6 * x + 5] + bottom[6 * x + 2] + bottom[6 * x + 5] + 2) >> 2;
+			blue[(size_t)row * width / 2 + x] = (uint8_t)(128 + ((-38 * r - 74 * g + 112 * b + 128) >> 8));
+			red[(size_t)row * width / 2 + x] = (uint8_t)(128 + ((112 * r - 94 * g - 18 * b + 128) >> 8));
+		}
+	}
+
+	size_t size = (size_t)width * height * 3 / 2;
+	return fputs("FRAME\n", file) >= 0 && fwrite(planes, 1, size, file) == size;
+}
+
+static void WriteFrames(void* data) {
+	ZoomOutput* output = (ZoomOutput*)data;
+	const int width = output->width, height = output->height;
+	uint8_t* rgb = (uint8_t*)malloc((size_t)width * height * 3);
+	uint8_t* planes = (uint8_t*)malloc((size_t)width * height * 3 / 2);
+
+	for (int slot = 0;; slot = (slot + 1) % ZOOM_SLOTS) {
+		MutexLock(&output->lock);
+		while (!output->full[slot] && !output->finished) {
+			ConditionWait(&output->changed, &output->lock);
+		}
+		if (!output->full[slot]) {
+			MutexUnlock(&output->lock);
+			break;
+		}
+		MutexUnlock(&output->lock);
+
+		//the pool is busy with the next frame, coloring stays on this thread
+		ColorizePixels(output->frames[slot], width * height, output->palette, rgb, 3);
+		ColorizeSamples(&output->samples[slot], output->palette, rgb, 3);
+		bool failed = !WriteFrame(output->file, rgb, width, height, planes);
+
+		MutexLock(&output->lock);
+		output->full[slot] = false;
+		if (failed)
+			output->failed = true;
+		ConditionBroadcast(&output->changed);
+		MutexUnlock(&output->lock);
+	}
+	free(rgb);
+	free(planes);
+}
+
+
+static Viewport KeyframeView(const Keyframe* keys, int count, double time, int width, int height) {
+	int k = 0;
+	while (k + 2 < count && keys[k + 1].time <= time) {
+		k++;
+	}
+	const Keyframe* a = &keys[k];
+	const Keyframe* b = &keys[minimum(k + 1, count - 1)];
+	double t = b->time > a->time ? (time - a->time) / (b->time - a->time) : 0.0;
+	t = t < 0.0 ? 0.0 : t > 1.0 ? 1.0 : t;
+
+	Viewport viewport;
+	double span = ZOOM_SPAN * pow(10.0, -(a->zoom + (b->zoom - a->zoom) * t));
+	viewport.spanReal = span;
+	viewport.spanImag = span * height / width;
+
+	//weights of both keyframes such that the fixed point of the zoom keeps its place on screen;
+	//the smaller one is applied, deep keyframes would lose their digits otherwise
+	double spanA = ZOOM_SPAN * pow(10.0, -a->zoom), spanB = ZOOM_SPAN * pow(10.0, -b->zoom);
+	double toB = t, toA = 1.0 - t;
+	if (fabs(spanA - spanB) > 1e-9 * spanA) {
+		toB = (spanA - span) / (spanA - spanB);
+		toA = (span - spanB) / (spanA - spanB);
+	}
+	if (toB <= toA) {
+		viewport.centerReal = FixedAdd(a->centerReal, FixedFromDouble(toB * FixedToDouble(FixedSub(b->centerReal, a->centerReal))));
+		viewport.centerImag = FixedAdd(a->centerImag, FixedFromDouble(toB * FixedToDouble(FixedSub(b->centerImag, a->centerImag))));
+	}
+	else {
+		viewport.centerReal = FixedAdd(b->centerReal, FixedFromDouble(toA * FixedToDouble(FixedSub(a->centerReal, b->centerReal))));
+		viewport.centerImag = FixedAdd(b->centerImag, FixedFromDouble(toA * FixedToDouble(FixedSub(a->centerImag, b->centerImag))));
+	}
+	return viewport;
+}
+
+
+typedef struct ReuseJob {
+	int width, height;
+	const Shade* oldColors;
+	const float* oldOffsets;	//sample position minus pixel position, x and y in old pixels
+	Shade* colors;
+	float* offsets;
+	double scaleX, scaleY;		//old pixel size in new pixels
+	double shiftX, shiftY;		//old center minus new center in new pixels
+	double tolerance;
+	TileOrbits* missing;		//pixels to render, per tile
+	volatile int32_t reused;
+}ReuseJob;
+
+static void ReuseTile(void* data, int item, int worker) {
+	ReuseJob* job = (ReuseJob*)data;
+	const int width = job->width, height = job->height;
+	Tile tile = TileGet(item, width, height, TILE_SIZE);
+	TileOrbits* missing = &job->missing[item];
+	missing->count = 0;
+	int reused = 0;
+
+	PixelOrbit pixel = { 0 };
+	for (int y = tile.y0; y < tile.y1; y++) {
+		//the nearest old pixel, its sample is at most tolerance further away than that
+		double gridY = y - height * 0.5;
+		int sy = (int)floor((gridY - job->shiftY) / job->scaleY + height * 0.5 + 0.5);
+		for (int x = tile.x0; x < tile.x1; x++) {
+			int index = x + y * width;
+			double gridX = x - width * 0.5;
+			int sx = (int)floor((gridX - job->shiftX) / job->scaleX + width * 0.5 + 0.5);
+			if (sx >= 0 && sx < width && sy >= 0 && sy < height) {
+				int source = sx + sy * width;
+				double errorX = (sx - width * 0.5 + job->oldOffsets[2 * source]) * job->scaleX + job->shiftX - gridX;
+				double errorY = (sy - height * 0.5 + job->oldOffsets[2 * source + 1]) * job->scaleY + job->shiftY - gridY;
+				if (fabs(errorX) <= job->tolerance && fabs(errorY) <= job->tolerance) {
+					job->colors[index] = job->oldColors[source];
+					job->offsets[2 * index] = (float)errorX;
+					job->offsets[2 * index + 1] = (float)errorY;
+					reused++;
+					continue;
+				}
+			}
+			job->offsets[2 * index] = 0.0f;
+			job->offsets[2 * index + 1] = 0.0f;
+			pixel.index = index;
+			TileOrbitsAppend(missing, &pixel);
+		}
+	}
+	AtomicAdd(&job->reused, reused);
+}
+
+
+static void PrintUsage(void) {
+	fprintf(stderr,
+		"usage: mandelbrot zoom [options] output.y4m|-\n"
+		"  --keyframe T REAL IMAG Z at T seconds center on REAL IMAG at zoom level Z, the view\n"
+		"                           width is 4 / 10^Z; repeat for every keyframe, at least two\n"
+		"  --keyframes FILE         keyframes from a file, one \"T REAL IMAG Z\" per line\n"
+		"  --size WIDTH HEIGHT      frame size in pixels, even (default 1280 720)\n"
+		"  --fps N                  frames per second (default 30)\n"
+		"  --iterations N           maximum iterations (default 1000)\n"
+		"  --palette R G B          color weights as on the sliders (default 5 2 3)\n"
+		"  --reuse PIXELS           distance up to which samples of the previous frame are reused,\n"
+		"                           0 renders every pixel (default 0.25)\n"
+		"  --distance               color by estimated distance to the set\n"
+		"  --antialias N            supersample edge pixels with N samples each (default off)\n"
+		"The video goes to stdout for -, e.g. mandelbrot zoom ... - | ffmpeg -i - zoom.mp4\n");
+}
+
+//appends a keyframe, times have to increase
+static bool AddKeyframe(Keyframe** keys, int* count, char* fields[4]) {
+	Keyframe key;
+	if (!ParseDouble(fields[0], &key.time) || !FixedParse(fields[1], &key.centerReal) ||
+		!FixedParse(fields[2], &key.centerImag) || !ParseDouble(fields[3], &key.zoom))
+		return false;
+	if (*count > 0 && key.time <= (*keys)[*count - 1].time)
+		return false;
+	*keys = (Keyframe*)realloc(*keys, (*count + 1) * sizeof(Keyframe));
+	(*keys)[(*count)++] = key;
+	return true;
+}
+
+static bool ReadKeyframes(const char* path, Keyframe** keys, int* count) {
+	FILE* file = fopen(path, "r");
+	if (!file)
+		return false;
+	char line[1024];
+	bool ok = true;
+	while (ok && fgets(line, sizeof(line), file)) {
+		char* fields[4];
+		int n = 0;
+		for (char* field = strtok(line, " \t\r\n"); field && n < 5; field = strtok(NULL, " \t\r\n")) {
+			if (field[0] == '#')
+				break;
+			if (n < 4)
+				fields[n] = field;
+			n++;
+		}
+		//blank lines and comments are skipped
+		if (n > 0)
+			ok = n == 4 && AddKeyframe(keys, count, fields);
+	}
+	fclose(file);
+	return ok;
+}
+
+int ZoomMain(int argc, char* argv[]) {
+	int width = 1280, height = 720, fps = 30;
+	double tolerance = 0.25;
+	float weights[3] = { 5.0f, 2.0f, 3.0f };
+	const char* path = NULL;
+	Keyframe* keys = NULL;
+	int keyCount = 0;
+	maxIter = 1000;
+
+	for (int i = 0; i < argc; i++) {
+		const char* arg = argv[i];
+		int left = argc - i - 1;
+		bool ok = true;
+
+		if (strcmp(arg, "--keyframe") == 0 && left >= 4) {
+			ok = AddKeyframe(&keys, &keyCount, argv + i + 1);
+			i += 4;
+		}
+		else if (strcmp(arg, "--keyframes") == 0 && left >= 1) {
+			ok = ReadKeyframes(argv[i + 1], &keys, &keyCount);
+			i += 1;
+		}
+		else if (strcmp(arg, "--size") == 0 && left >= 2) {
+			ok = ParseInt(argv[i + 1], 2, &width) && ParseInt(argv[i + 2], 2, &height) && width % 2 == 0 && height % 2 == 0;
+			i += 2;
+		}
+		else if (strcmp(arg, "--fps") == 0 && left >= 1) {
+			ok = ParseInt(argv[i + 1], 1, &fps);
+			i += 1;
+		}
+		else if (strcmp(arg, "--iterations") == 0 && left >= 1) {
+			ok = ParseInt(argv[i + 1], 1, &maxIter);
+			i += 1;
+		}
+		else if (strcmp(arg, "--palette") == 0 && left >= 3) {
+			ok = ParsePalette(argv + i + 1, weights);
+			i += 3;
+		}
+		else if (strcmp(arg, "--reuse") == 0 && left >= 1) {
+			ok = ParseDouble(argv[i + 1], &tolerance) && tolerance >= 0.0 && tolerance < 0.5;
+			i += 1;
+		}
+		else if (strcmp(arg, "--distance") == 0) {
+			renderMode = RENDER_DISTANCE;
+		}
+		else if (strcmp(arg, "--antialias") == 0 && left >= 1) {
+			ok = ParseInt(argv[i + 1], 1, &antialias.samples);
+			i += 1;
+		}
+		else if ((arg[0] != '-' || strcmp(arg, "-") == 0) && !path) {
+			path = arg;
+		}
+		else {
+			ok = false;
+		}
+
+		if (!ok) {
+			fprintf(stderr, "zoom: bad argument %s\n", arg);
+			PrintUsage();
+			free(keys);
+			return 1;
+		}
+	}
+	if (!path || keyCount < 2) {
+		PrintUsage();
+		free(keys);
+		return 1;
+	}
+
+	ZoomOutput output = { 0 };
+	if (strcmp(path, "-") == 0) {
+#ifdef _WIN32
+		_setmode(_fileno(stdout), _O_BINARY);
+#endif
+		output.file = stdout;
+	}
+	else {
+		output.file = fopen(path, "wb");
+	}
+	if (!output.file) {
+		fprintf(stderr, "zoom: cannot create %s\n", path);
+		free(keys);
+		return 1;
+	}
+	fprintf(output.file, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", width, height, fps);
+
+	const size_t pixels = (size_t)width * height;
+	Palette palette = { 0 };
+	PaletteUpdate(&palette, weights);
+	output.width = width;
+	output.height = height;
+	output.palette = &palette;
+	MutexInit(&output.lock);
+	ConditionInit(&output.changed);
+	for (int i = 0; i < ZOOM_SLOTS; i++) {
+		output.frames[i] = (Shade*)malloc(pixels * sizeof(Shade));
+	}
+	float* offsets[2];
+	offsets[0] = (float*)malloc(pixels * 2 * sizeof(float));
+	offsets[1] = (float*)malloc(pixels * 2 * sizeof(float));
+	int tileCount = TileCount(width, height, TILE_SIZE);
+	TileOrbits* missing = (TileOrbits*)calloc(tileCount, sizeof(TileOrbits));
+
+	Thread writer;
+	bool started = ThreadStart(&writer, WriteFrames, &output) != 0;
+	bool failed = !started;
+
+	int frames = (int)floor(keys[keyCount - 1].time * fps + 1e-9) + 1;
+	long long reused = 0, computed = 0;
+	double begin = TimeNow();
+	Viewport previous = { 0 };
+
+	for (int i = 0; i < frames && !failed; i++) {
+		Viewport viewport = KeyframeView(keys, keyCount, (double)i / fps, width, height);
+		int slot = i % ZOOM_SLOTS;
+		MutexLock(&output.lock);
+		while (output.full[slot] && !output.failed) {
+			ConditionWait(&output.changed, &output.lock);
+		}
+		failed = output.failed;
+		MutexUnlock(&output.lock);
+		if (failed)
+			break;
+
+		Shade* colors = output.frames[slot];
+		if (i == 0 || tolerance <= 0.0) {
+			RenderTiles(&viewport, width, height, colors, NULL, 0, NULL, NULL);
+			memset(offsets[i & 1], 0, pixels * 2 * sizeof(float));
+		}
+		else {
+			//the previous frame stays untouched until this one is done, the writer only reads it
+			ReuseJob job;
+			job.width = width;
+			job.height = height;
+			job.oldColors = output.frames[(i - 1) % ZOOM_SLOTS];
+			job.oldOffsets = offsets[(i - 1) & 1];
+			job.colors = colors;
+			job.offsets = offsets[i & 1];
+			job.scaleX = previous.spanReal / viewport.spanReal;
+			job.scaleY = previous.spanImag / viewport.spanImag;
+			job.shiftX = FixedToDouble(FixedSub(previous.centerReal, viewport.centerReal)) / viewport.spanReal * width;
+			job.shiftY = FixedToDouble(FixedSub(previous.centerImag, viewport.centerImag)) / viewport.spanImag * height;
+			job.tolerance = tolerance;
+			job.missing = missing;
+			job.reused = 0;
+			PoolRun(ReuseTile, &job, tileCount);
+			reused += job.reused;
+			RenderPixels(&viewport, width, height, colors, missing, NULL);
+		}
+		computed += renderStats.computed;
+		if (AntialiasEnabled())
+			AntialiasFrame(&viewport, width, height, colors, &output.samples[slot], NULL);
+		previous = viewport;
+
+		MutexLock(&output.lock);
+		output.full[slot] = true;
+		ConditionBroadcast(&output.changed);
+		MutexUnlock(&output.lock);
+		fprintf(stderr, "\rframe %d / %d", i + 1, frames);
+	}
+
+	if (started) {
+		MutexLock(&output.lock);
+		output.finished = true;
+		ConditionBroadcast(&output.changed);
+		MutexUnlock(&output.lock);
+		ThreadJoin(writer);
+	}
+	failed = failed || output.failed;
+	double seconds = TimeNow() - begin;
+
+	if (output.file != stdout)
+		failed = fclose(output.file) != 0 || failed;
+	else
+		failed = fflush(stdout) != 0 || failed;
+	if (failed) {
+		fprintf(stderr, "\nzoom: writing %s failed\n", path);
+	}
+	else {
+		fprintf(stderr, "\n%d frames %d x %d, %.2f s (%.2f frames/s), %.1f%% of the pixels reused, %.1f%% iterated\n",
+			frames, width, height, seconds, frames / seconds, 100.0 * reused / ((double)pixels * frames), 100.0 * computed / ((double)pixels * frames));
+	}
+
+	for (int i = 0; i < tileCount; i++) {
+		free(missing[i].items);
+	}
+	free(missing);
+	free(offsets[0]);
+	free(offsets[1]);
+	for (int i = 0; i < ZOOM_SLOTS; i++) {
+		free(output.frames[i]);
+		EdgeSamplesFree(&output.samples[i]);
+	}
+	PaletteFree(&palette);
+	ConditionDestroy(&output.changed);
+	MutexDestroy(&output.lock);
+	free(keys);
+	return failed ? 1 : 0;
+}